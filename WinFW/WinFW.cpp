@@ -1,11 +1,42 @@
 #include "WinFW.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <new>
 #include <string>
 #include <cstring>
+#include <limits>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define WINFW_SSE2
+#endif
+
+#ifdef WINFW_HEADLESS
+#include <chrono>
+#include <map>
+#else
 #include <windowsx.h>
+#endif
 
+#ifdef _MSC_VER
 #pragma warning(disable : 4250)
+#endif
 
-#define Interface_GetRefName(name)	const char* name::GetRefName() { return #name; }
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+
+#define Interface_GetRefName(name)	const char* name::GetRefName() { return #name; } \
+	static_assert(name::RefID == WinFW::Hidden::RefHash(#name), #name " : RefID mismatch");
 
 Interface_GetRefName(WinFW::Ref)
 Interface_GetRefName(WinFW::Copyable)
@@ -22,1621 +53,5072 @@ Interface_GetRefName(WinFW::WindowExStyle)
 Interface_GetRefName(WinFW::WindowConfig)
 Interface_GetRefName(WinFW::Keyboard)
 Interface_GetRefName(WinFW::Mouse)
+Interface_GetRefName(WinFW::InputQueue)
+Interface_GetRefName(WinFW::JobCounter)
 
 HINSTANCE g_hInstance;
 
-// IO
-namespace WinFW {
-	namespace IO {
-		void MsgBox::notify(const char *title, const char *body) {
-			MessageBoxA(nullptr, body, title, MB_OK | MB_ICONINFORMATION);
-		}
+// Headless
+#ifdef WINFW_HEADLESS
+struct HWND__ {
+	WNDPROC proc;
+	DWORD style;
+	DWORD exStyle;
+	HMENU menu;
+	RECT rect;
+	LONG_PTR userData;
+	bool visible;
+	std::wstring title;
+	std::map<std::wstring, HANDLE> props;
+	DWORD thread;
+};
+
+// Waitable timer or auto-reset event. Events may be set from another thread, so every field is guarded
+// by Headless_Impl::mutex.
+struct HeadlessObject {
+	bool event;
+	bool signaled;
+	bool armed;
+	INT64 due;
+};
 
-		void MsgBox::notify(const wchar_t *title, const wchar_t *body) {
-			MessageBoxW(nullptr, body, title, MB_OK | MB_ICONINFORMATION);
+namespace WinFW {
+	struct Headless_Impl {
+		static constexpr UINT maxRawInput = 256;
+
+		static std::deque<MSG> queue;
+		static std::map<std::wstring, WNDPROC> classes;
+		static BYTE keyStates[256];
+		static POINT cursor;
+		static bool manualClock;
+		static INT64 manualCount;
+		static RAWINPUT rawInputs[maxRawInput];
+		static bool rawInputQueued[maxRawInput];
+		static UINT rawInputNext;
+		static UINT rawInputRead;
+		static std::mutex mutex;
+		static std::condition_variable wake;
+
+		// QS_* class of a queued message, for the PM_QS_* filters of PeekMessageW.
+		static UINT queueStatus(UINT message) {
+			if (message == WM_INPUT) return QS_RAWINPUT;
+			if (message >= WM_KEYFIRST && message <= WM_KEYLAST) return QS_KEY;
+			if (message == WM_MOUSEMOVE) return QS_MOUSEMOVE;
+			if (message >= WM_MOUSEFIRST && message <= WM_MOUSELAST) return QS_MOUSEBUTTON;
+			if (message == WM_PAINT) return QS_PAINT;
+			if (message == WM_TIMER) return QS_TIMER;
+			return QS_POSTMESSAGE;
+		}
+
+		// A report's slot stays taken while its WM_INPUT is queued. Called with mutex held.
+		static void release(const MSG &msg) {
+			if (msg.message != WM_INPUT) return;
+			const RAWINPUT *rawInput = reinterpret_cast<const RAWINPUT*>(msg.lParam);
+			if (rawInput >= rawInputs && rawInput < rawInputs + maxRawInput) rawInputQueued[rawInput - rawInputs] = false;
+		}
+
+		static INT64 now() {
+			if (manualClock) return manualCount;
+			return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
 		}
+	};
 
-		void MsgBox::error(const char *title, const char *body) {
-			MessageBoxA(nullptr, body, title, MB_OK | MB_ICONERROR);
-		}
+	std::deque<MSG> Headless_Impl::queue;
+	std::map<std::wstring, WNDPROC> Headless_Impl::classes;
+	BYTE Headless_Impl::keyStates[256] = {};
+	POINT Headless_Impl::cursor = {};
+	bool Headless_Impl::manualClock = false;
+	INT64 Headless_Impl::manualCount = 0;
+	RAWINPUT Headless_Impl::rawInputs[Headless_Impl::maxRawInput] = {};
+	bool Headless_Impl::rawInputQueued[Headless_Impl::maxRawInput] = {};
+	UINT Headless_Impl::rawInputNext = 0;
+	UINT Headless_Impl::rawInputRead = 0;
+	std::mutex Headless_Impl::mutex;
+	std::condition_variable Headless_Impl::wake;
+
+	void Headless::reset() {
+		{
+			std::lock_guard<std::mutex> lock(Headless_Impl::mutex);
+			Headless_Impl::queue.clear();
+			std::memset(Headless_Impl::rawInputQueued, 0, sizeof(Headless_Impl::rawInputQueued));
+			Headless_Impl::rawInputNext = 0;
+			Headless_Impl::rawInputRead = 0;
+		}
+		std::memset(Headless_Impl::keyStates, 0, sizeof(Headless_Impl::keyStates));
+		Headless_Impl::cursor = {};
+		Headless_Impl::manualClock = false;
+		Headless_Impl::manualCount = 0;
+	}
 
-		void MsgBox::error(const wchar_t *title, const wchar_t *body) {
-			MessageBoxW(nullptr, body, title, MB_OK | MB_ICONERROR);
-		}
+	void Headless::postMessage(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam) {
+		PostMessageW(hWnd, uMsg, wParam, lParam);
 	}
-}
 
-// EventLoop
-namespace WinFW {
-	struct EventLoop_Impl {
-		static bool isRunning;
-		static double tpc;
-		static double tpl;
-		static double tpf;
-		static INT64 currTime;
-		static INT64 prevLoop;
-		static INT64 prevFrame;
-		static MSG msg;
-	};
+	void Headless::postKey(HWND hWnd, BYTE vKey, bool down) {
+		bool wasDown = (Headless_Impl::keyStates[vKey] & (1 << 7)) != 0;
+		setKeyState(vKey, down);
+		LPARAM lParam = 1 | (wasDown ? 1 << 30 : 0) | (down ? 0 : 1U << 31);
+		PostMessageW(hWnd, down ? WM_KEYDOWN : WM_KEYUP, vKey, lParam);
+	}
 
-	bool EventLoop_Impl::isRunning = false;
-	double EventLoop_Impl::tpc = 0.0;
-	double EventLoop_Impl::tpl = 0.0;
-	double EventLoop_Impl::tpf = 0.0;
-	INT64 EventLoop_Impl::currTime = 0;
-	INT64 EventLoop_Impl::prevLoop = 0;
-	INT64 EventLoop_Impl::prevFrame = 0;
-	MSG EventLoop_Impl::msg = {};
+	// Fails while the slot it would reuse still belongs to a queued WM_INPUT, i.e. once maxRawInput reports wait.
+	bool Headless::postRawInput(HWND hWnd, const RAWINPUT &rawInput) {
+		MSG msg{ hWnd, WM_INPUT, 0, 0, static_cast<DWORD>(Headless_Impl::now() / 1000000), Headless_Impl::cursor };
+		std::lock_guard<std::mutex> lock(Headless_Impl::mutex);
+		UINT index = Headless_Impl::rawInputNext % Headless_Impl::maxRawInput;
+		if (Headless_Impl::rawInputQueued[index]) return false;
+		if (Headless_Impl::rawInputNext - Headless_Impl::rawInputRead == Headless_Impl::maxRawInput) ++Headless_Impl::rawInputRead;
+
+		RAWINPUT *slot = &Headless_Impl::rawInputs[index];
+		*slot = rawInput;
+		slot->header.dwSize = sizeof(RAWINPUT);
+		Headless_Impl::rawInputQueued[index] = true;
+		++Headless_Impl::rawInputNext;
+
+		msg.lParam = reinterpret_cast<LPARAM>(slot);
+		Headless_Impl::queue.push_back(msg);
+		Headless_Impl::wake.notify_all();
+		return true;
+	}
 
-	void EventLoop::init() {
-		INT64 cps;
-		EventLoop_Impl::isRunning = true;
-		QueryPerformanceFrequency((LARGE_INTEGER*)&cps);
-		EventLoop_Impl::tpc = 1.0 / cps;
-		QueryPerformanceCounter(reinterpret_cast<LARGE_INTEGER*>(&EventLoop_Impl::prevLoop));
-		EventLoop_Impl::prevFrame = EventLoop_Impl::prevLoop;
+	bool Headless::postRawMouseMove(HWND hWnd, LONG x, LONG y) {
+		RAWINPUT rawInput = {};
+		rawInput.header.dwType = RIM_TYPEMOUSE;
+		rawInput.data.mouse.usFlags = MOUSE_MOVE_RELATIVE;
+		rawInput.data.mouse.lLastX = x;
+		rawInput.data.mouse.lLastY = y;
+		return postRawInput(hWnd, rawInput);
 	}
 
-	INT64 EventLoop::getCountPerSecond() {
-		INT64 cps;
-		QueryPerformanceCounter(reinterpret_cast<LARGE_INTEGER*>(&cps));
-		return cps;
+	void Headless::setKeyState(BYTE vKey, bool down) {
+		if (down) Headless_Impl::keyStates[vKey] = static_cast<BYTE>((Headless_Impl::keyStates[vKey] & 1) ^ 1) | (1 << 7);
+		else Headless_Impl::keyStates[vKey] &= 1;
 	}
 
-	INT64 EventLoop::getCurrentCount() {
-		INT64 curr;
-		QueryPerformanceCounter(reinterpret_cast<LARGE_INTEGER*>(&curr));
-		return curr;
+	void Headless::setCursorPos(int x, int y) {
+		Headless_Impl::cursor = { x, y };
 	}
 
-	INT64 EventLoop::getCountLastLoop() {
-		return EventLoop_Impl::prevLoop;
+	size_t Headless::getPendingMessages() {
+		std::lock_guard<std::mutex> lock(Headless_Impl::mutex);
+		return Headless_Impl::queue.size();
 	}
 
-	INT64 EventLoop::getCountLastFrame() {
-		return EventLoop_Impl::prevFrame;
+	void Headless::useManualClock(bool manual) {
+		if (manual && !Headless_Impl::manualClock) Headless_Impl::manualCount = Headless_Impl::now();
+		Headless_Impl::manualClock = manual;
 	}
 
-	bool EventLoop::fps(UINT fps) {
-		EventLoop_Impl::tpf = (EventLoop_Impl::currTime - EventLoop_Impl::prevFrame) * EventLoop_Impl::tpc;
-		if (1.0 / EventLoop_Impl::tpf <= fps) {
-			EventLoop_Impl::prevFrame = EventLoop_Impl::currTime;
-			return true;
-		}
-		return false;
+	void Headless::advanceClock(INT64 count) {
+		Headless_Impl::manualCount += count;
 	}
+}
 
-	bool EventLoop::isActive(HWND hWnd, UINT wMsgFilterMin, UINT wMsgFilterMax, UINT wRemoveMsg) {
-		while (PeekMessageW(&EventLoop_Impl::msg, nullptr, wMsgFilterMin, wMsgFilterMax, wRemoveMsg)) {
-			TranslateMessage(&EventLoop_Impl::msg);
-			DispatchMessageW(&EventLoop_Impl::msg);
-		}
+using WinFW::Headless_Impl;
 
-		QueryPerformanceCounter(reinterpret_cast<LARGE_INTEGER*>(&EventLoop_Impl::currTime));
-		EventLoop_Impl::tpl = (EventLoop_Impl::currTime - EventLoop_Impl::prevLoop) * EventLoop_Impl::tpc;
-		EventLoop_Impl::prevLoop = EventLoop_Impl::currTime;
-		return EventLoop_Impl::isRunning;
+int MessageBoxA(HWND, LPCSTR text, LPCSTR caption, UINT) {
+	std::fprintf(stderr, "[%s] %s\n", caption, text);
+	return IDOK;
+}
+
+int MessageBoxW(HWND, LPCWSTR text, LPCWSTR caption, UINT) {
+	std::fprintf(stderr, "[%ls] %ls\n", caption, text);
+	return IDOK;
+}
+
+BOOL QueryPerformanceFrequency(LARGE_INTEGER *frequency) {
+	frequency->QuadPart = 1000000000;
+	return TRUE;
+}
+
+BOOL QueryPerformanceCounter(LARGE_INTEGER *count) {
+	count->QuadPart = Headless_Impl::now();
+	return TRUE;
+}
+
+BOOL PeekMessageW(LPMSG lpMsg, HWND hWnd, UINT wMsgFilterMin, UINT wMsgFilterMax, UINT wRemoveMsg) {
+	std::lock_guard<std::mutex> lock(Headless_Impl::mutex);
+	for (auto it = Headless_Impl::queue.begin(); it != Headless_Impl::queue.end(); ++it) {
+		if (hWnd != nullptr && it->hwnd != hWnd) continue;
+		if ((wMsgFilterMin != 0 || wMsgFilterMax != 0) && (it->message < wMsgFilterMin || it->message > wMsgFilterMax)) continue;
+		if ((wRemoveMsg >> 16) != 0 && (Headless_Impl::queueStatus(it->message) & (wRemoveMsg >> 16)) == 0) continue;
+		*lpMsg = *it;
+		if (wRemoveMsg & PM_REMOVE) {
+			Headless_Impl::release(*it);
+			Headless_Impl::queue.erase(it);
+		}
+		return TRUE;
 	}
+	return FALSE;
+}
 
-	void EventLoop::destroy() {
-		EventLoop_Impl::isRunning = false;
+BOOL PostMessageW(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam) {
+	MSG msg{ hWnd, uMsg, wParam, lParam, static_cast<DWORD>(Headless_Impl::now() / 1000000), Headless_Impl::cursor };
+	std::lock_guard<std::mutex> lock(Headless_Impl::mutex);
+	Headless_Impl::queue.push_back(msg);
+	Headless_Impl::wake.notify_all();
+	return TRUE;
+}
+
+BOOL TranslateMessage(const MSG*) {
+	return FALSE;
+}
+
+LRESULT DispatchMessageW(const MSG *lpMsg) {
+	if (lpMsg->hwnd == nullptr || lpMsg->hwnd->proc == nullptr) return 0;
+	return lpMsg->hwnd->proc(lpMsg->hwnd, lpMsg->message, lpMsg->wParam, lpMsg->lParam);
+}
+
+LRESULT DefWindowProcW(HWND, UINT, WPARAM, LPARAM) {
+	return 0;
+}
+
+LRESULT CallWindowProcW(WNDPROC lpPrevWndFunc, HWND hWnd, UINT Msg, WPARAM wParam, LPARAM lParam) {
+	return lpPrevWndFunc == nullptr ? 0 : lpPrevWndFunc(hWnd, Msg, wParam, lParam);
+}
+
+BOOL RegisterRawInputDevices(const RAWINPUTDEVICE*, UINT, UINT) {
+	return TRUE;
+}
+
+UINT GetRawInputData(HRAWINPUT hRawInput, UINT uiCommand, LPVOID pData, PUINT pcbSize, UINT) {
+	const RAWINPUT *rawInput = reinterpret_cast<const RAWINPUT*>(hRawInput);
+	std::lock_guard<std::mutex> lock(Headless_Impl::mutex);
+	if (uiCommand != RID_INPUT || rawInput == nullptr || rawInput->header.dwSize == 0) return static_cast<UINT>(-1);
+	if (pData == nullptr) {
+		*pcbSize = sizeof(RAWINPUT);
+		return 0;
 	}
+	if (*pcbSize < sizeof(RAWINPUT)) return static_cast<UINT>(-1);
+	std::memcpy(pData, rawInput, sizeof(RAWINPUT));
+	return sizeof(RAWINPUT);
+}
 
-	MSG EventLoop::getMSG() {
-		return EventLoop_Impl::msg;
+// Reports read here are marked consumed (dwSize = 0), so their WM_INPUT no longer yields data. Reports whose
+// WM_INPUT was already retrieved are skipped, as they left the buffer with it.
+UINT GetRawInputBuffer(PRAWINPUT pData, PUINT pcbSize, UINT) {
+	std::lock_guard<std::mutex> lock(Headless_Impl::mutex);
+	UINT blockSize = static_cast<UINT>(RAWINPUT_ALIGN(sizeof(RAWINPUT)));
+	if (pData == nullptr) {
+		*pcbSize = Headless_Impl::rawInputRead == Headless_Impl::rawInputNext ? 0 : blockSize;
+		return 0;
 	}
 
-	double EventLoop::getTimePerFrame() {
-		return EventLoop_Impl::tpf;
+	UINT count = 0;
+	BYTE *out = reinterpret_cast<BYTE*>(pData);
+	while (Headless_Impl::rawInputRead != Headless_Impl::rawInputNext && (count + 1) * blockSize <= *pcbSize) {
+		UINT index = Headless_Impl::rawInputRead++ % Headless_Impl::maxRawInput;
+		RAWINPUT *slot = &Headless_Impl::rawInputs[index];
+		if (!Headless_Impl::rawInputQueued[index] || slot->header.dwSize == 0) continue;
+		std::memcpy(out + count * blockSize, slot, sizeof(RAWINPUT));
+		slot->header.dwSize = 0;
+		++count;
 	}
+	return count;
+}
 
-	double EventLoop::getTimePerLoop() {
-		return EventLoop_Impl::tpl;
+HCURSOR LoadCursorW(HINSTANCE, LPCWSTR) {
+	return nullptr;
+}
+
+ATOM RegisterClassExW(const WNDCLASSEXW *lpwcx) {
+	if (lpwcx->lpszClassName == nullptr) return 0;
+	std::lock_guard<std::mutex> lock(Headless_Impl::mutex);
+	Headless_Impl::classes[lpwcx->lpszClassName] = lpwcx->lpfnWndProc;
+	return static_cast<ATOM>(Headless_Impl::classes.size());
+}
+
+BOOL UnregisterClassW(LPCWSTR lpClassName, HINSTANCE) {
+	std::lock_guard<std::mutex> lock(Headless_Impl::mutex);
+	return Headless_Impl::classes.erase(lpClassName) != 0;
+}
+
+HWND CreateWindowExW(DWORD dwExStyle, LPCWSTR lpClassName, LPCWSTR lpWindowName, DWORD dwStyle, int x, int y, int width, int height,
+	HWND, HMENU hMenu, HINSTANCE, LPVOID) {
+	WNDPROC proc;
+	{
+		std::lock_guard<std::mutex> lock(Headless_Impl::mutex);
+		auto it = Headless_Impl::classes.find(lpClassName);
+		if (it == Headless_Impl::classes.end()) return nullptr;
+		proc = it->second;
 	}
+	if (x == CW_USEDEFAULT) x = 0;
+	if (y == CW_USEDEFAULT) y = 0;
+	return new HWND__{ proc, dwStyle, dwExStyle, hMenu, { x, y, x + width, y + height }, 0,
+		(dwStyle & WS_VISIBLE) != 0, lpWindowName == nullptr ? L"" : lpWindowName, {}, GetCurrentThreadId() };
 }
 
-// Mouse
-namespace WinFW {
-	void Mouse::useRawInputMouse(Window *window) {
-		HWND hWnd = window == nullptr ? nullptr : window->get();
-		RAWINPUTDEVICE rid{ 0x01, 0x02, 0, hWnd };
-		RegisterRawInputDevices(&rid, 1, sizeof(RAWINPUTDEVICE));
+BOOL DestroyWindow(HWND hWnd) {
+	if (hWnd == nullptr) return FALSE;
+	if (hWnd->proc != nullptr) hWnd->proc(hWnd, WM_DESTROY, 0, 0);
+	if (hWnd->proc != nullptr) hWnd->proc(hWnd, WM_NCDESTROY, 0, 0);
+	{
+		// Like Win32, a destroyed window's pending messages go with it, so no later dispatch reads the freed HWND.
+		std::lock_guard<std::mutex> lock(Headless_Impl::mutex);
+		Headless_Impl::queue.erase(std::remove_if(Headless_Impl::queue.begin(), Headless_Impl::queue.end(),
+			[hWnd](const MSG &msg) {
+				if (msg.hwnd != hWnd) return false;
+				Headless_Impl::release(msg);
+				return true;
+			}), Headless_Impl::queue.end());
 	}
+	delete hWnd;
+	return TRUE;
+}
 
-	void Mouse::disableRawInputMouse() {
-		RAWINPUTDEVICE rid{ 0x01, 0x02, RIDEV_REMOVE, nullptr };
-		RegisterRawInputDevices(&rid, 1, sizeof(RAWINPUTDEVICE));
+BOOL SetWindowTextW(HWND hWnd, LPCWSTR title) {
+	if (hWnd == nullptr) return FALSE;
+	hWnd->title = title == nullptr ? L"" : title;
+	return TRUE;
+}
+
+BOOL ShowWindow(HWND hWnd, int nCmdShow) {
+	if (hWnd == nullptr) return FALSE;
+	BOOL wasVisible = hWnd->visible;
+	hWnd->visible = nCmdShow != SW_HIDE;
+	return wasVisible;
+}
+
+BOOL UpdateWindow(HWND hWnd) {
+	return hWnd != nullptr;
+}
+
+BOOL SetWindowPos(HWND hWnd, HWND, int x, int y, int cx, int cy, UINT uFlags) {
+	if (hWnd == nullptr) return FALSE;
+	LONG width = hWnd->rect.right - hWnd->rect.left;
+	LONG height = hWnd->rect.bottom - hWnd->rect.top;
+	if (!(uFlags & SWP_NOMOVE)) {
+		hWnd->rect.left = x;
+		hWnd->rect.top = y;
+	}
+	if (!(uFlags & SWP_NOSIZE)) {
+		width = cx;
+		height = cy;
 	}
+	hWnd->rect.right = hWnd->rect.left + width;
+	hWnd->rect.bottom = hWnd->rect.top + height;
+	if (hWnd->proc != nullptr && !(uFlags & SWP_NOMOVE)) hWnd->proc(hWnd, WM_MOVE, 0, MAKELPARAM(hWnd->rect.left, hWnd->rect.top));
+	if (hWnd->proc != nullptr && !(uFlags & SWP_NOSIZE)) hWnd->proc(hWnd, WM_SIZE, SIZE_RESTORED, MAKELPARAM(width, height));
+	return TRUE;
 }
 
-// Interface
-namespace WinFW {
-	void init(HINSTANCE hInstance) {
-		g_hInstance = hInstance;
+BOOL AdjustWindowRectEx(LPRECT, DWORD, BOOL, DWORD) {
+	return TRUE;
+}
+
+LONG GetWindowLongW(HWND hWnd, int nIndex) {
+	if (hWnd == nullptr) return 0;
+	if (nIndex == GWL_STYLE) return static_cast<LONG>(hWnd->style);
+	if (nIndex == GWL_EXSTYLE) return static_cast<LONG>(hWnd->exStyle);
+	return 0;
+}
+
+LONG_PTR GetWindowLongPtrW(HWND hWnd, int nIndex) {
+	if (hWnd != nullptr && nIndex == GWLP_USERDATA) return hWnd->userData;
+	if (hWnd != nullptr && nIndex == GWLP_WNDPROC) return reinterpret_cast<LONG_PTR>(hWnd->proc);
+	return GetWindowLongW(hWnd, nIndex);
+}
+
+LONG_PTR SetWindowLongPtrW(HWND hWnd, int nIndex, LONG_PTR dwNewLong) {
+	if (hWnd == nullptr) return 0;
+	if (nIndex == GWLP_WNDPROC) {
+		LONG_PTR prev = reinterpret_cast<LONG_PTR>(hWnd->proc);
+		hWnd->proc = reinterpret_cast<WNDPROC>(dwNewLong);
+		return prev;
 	}
-	
-	class Ref_Impl : public virtual Ref {
-		unsigned long long m_refCount;
+	if (nIndex != GWLP_USERDATA) return 0;
+	LONG_PTR prev = hWnd->userData;
+	hWnd->userData = dwNewLong;
+	return prev;
+}
 
-		bool setInterface(void **const ppRef) {
-			if (ppRef != nullptr) {
-				incRef();
-				*ppRef = static_cast<Ref*>(this);
+BOOL SetPropW(HWND hWnd, LPCWSTR lpString, HANDLE hData) {
+	if (hWnd == nullptr) return FALSE;
+	hWnd->props[lpString] = hData;
+	return TRUE;
+}
+
+HANDLE GetPropW(HWND hWnd, LPCWSTR lpString) {
+	if (hWnd == nullptr) return nullptr;
+	auto it = hWnd->props.find(lpString);
+	return it == hWnd->props.end() ? nullptr : it->second;
+}
+
+HANDLE RemovePropW(HWND hWnd, LPCWSTR lpString) {
+	if (hWnd == nullptr) return nullptr;
+	auto it = hWnd->props.find(lpString);
+	if (it == hWnd->props.end()) return nullptr;
+	HANDLE res = it->second;
+	hWnd->props.erase(it);
+	return res;
+}
+
+HMENU GetMenu(HWND hWnd) {
+	return hWnd == nullptr ? nullptr : hWnd->menu;
+}
+
+DWORD GetWindowThreadProcessId(HWND hWnd, LPDWORD lpdwProcessId) {
+	if (lpdwProcessId != nullptr) *lpdwProcessId = 0;
+	return hWnd == nullptr ? 0 : hWnd->thread;
+}
+
+BOOL GetWindowRect(HWND hWnd, LPRECT lpRect) {
+	if (hWnd == nullptr) return FALSE;
+	*lpRect = hWnd->rect;
+	return TRUE;
+}
+
+BOOL GetClientRect(HWND hWnd, LPRECT lpRect) {
+	if (hWnd == nullptr) return FALSE;
+	*lpRect = { 0, 0, hWnd->rect.right - hWnd->rect.left, hWnd->rect.bottom - hWnd->rect.top };
+	return TRUE;
+}
+
+BOOL GetKeyboardState(PBYTE lpKeyState) {
+	std::memcpy(lpKeyState, Headless_Impl::keyStates, sizeof(Headless_Impl::keyStates));
+	return TRUE;
+}
+
+BOOL GetCursorPos(POINT *lpPoint) {
+	*lpPoint = Headless_Impl::cursor;
+	return TRUE;
+}
+
+HANDLE CreateWaitableTimerExW(LPVOID, LPCWSTR, DWORD, DWORD) {
+	return new HeadlessObject{ false, false, false, 0 };
+}
+
+BOOL SetWaitableTimer(HANDLE hTimer, const LARGE_INTEGER *dueTime, LONG, LPVOID, LPVOID, BOOL) {
+	HeadlessObject *timer = static_cast<HeadlessObject*>(hTimer);
+	if (timer == nullptr || timer->event) return FALSE;
+	std::lock_guard<std::mutex> lock(Headless_Impl::mutex);
+	timer->due = dueTime->QuadPart < 0 ? Headless_Impl::now() - dueTime->QuadPart * 100 : dueTime->QuadPart * 100;
+	timer->armed = true;
+	return TRUE;
+}
+
+// Events are always auto-reset.
+HANDLE CreateEventW(LPVOID, BOOL, BOOL bInitialState, LPCWSTR) {
+	return new HeadlessObject{ true, bInitialState != FALSE, false, 0 };
+}
+
+BOOL ResetEvent(HANDLE hEvent) {
+	HeadlessObject *event = static_cast<HeadlessObject*>(hEvent);
+	if (event == nullptr || !event->event) return FALSE;
+	std::lock_guard<std::mutex> lock(Headless_Impl::mutex);
+	event->signaled = false;
+	return TRUE;
+}
+
+BOOL SetEvent(HANDLE hEvent) {
+	HeadlessObject *event = static_cast<HeadlessObject*>(hEvent);
+	if (event == nullptr || !event->event) return FALSE;
+	std::lock_guard<std::mutex> lock(Headless_Impl::mutex);
+	event->signaled = true;
+	Headless_Impl::wake.notify_all();
+	return TRUE;
+}
+
+// Waits on the condition variable, so another thread can wake it with PostMessageW or SetEvent. Without a
+// due time and without events nothing could wake it, so it returns WAIT_TIMEOUT instead of blocking.
+DWORD MsgWaitForMultipleObjectsEx(DWORD nCount, const HANDLE *pHandles, DWORD dwMilliseconds, DWORD dwWakeMask, DWORD) {
+	std::unique_lock<std::mutex> lock(Headless_Impl::mutex);
+	INT64 timeout = dwMilliseconds == INFINITE ? std::numeric_limits<INT64>::max() : Headless_Impl::now() + dwMilliseconds * 1000000LL;
+
+	for (;;) {
+		if (dwWakeMask != 0 && !Headless_Impl::queue.empty()) return WAIT_OBJECT_0 + nCount;
+
+		INT64 due = timeout;
+		HeadlessObject *fired = nullptr;
+		DWORD index = 0;
+		bool hasEvent = false;
+		for (DWORD i = 0; i < nCount; ++i) {
+			HeadlessObject *object = static_cast<HeadlessObject*>(pHandles[i]);
+			if (object->event) {
+				if (object->signaled) {
+					object->signaled = false;
+					return WAIT_OBJECT_0 + i;
+				}
+				hasEvent = true;
+			}
+			else if (object->armed && object->due <= due) {
+				due = object->due;
+				fired = object;
+				index = i;
 			}
-			return true;
-		}
-	protected:
-		virtual bool queryRefByCmpPtr(void **const ppRef, const char *id) {
-			if (id == Ref::GetRefName()) return setInterface(ppRef);
-			else return false;
 		}
 
-		virtual bool queryRefByCmpStr(void **const ppRef, const char *id) {
-			if (std::strcmp(id, Ref::GetRefName()) == 0) return setInterface(ppRef);
-			else return false;
+		if (due == std::numeric_limits<INT64>::max()) {
+			if (!hasEvent) return WAIT_TIMEOUT;
+			Headless_Impl::wake.wait(lock);
+			continue;
 		}
-	public:
-		virtual ~Ref_Impl() = default;
 
-		Ref_Impl() : Ref_Impl(1ULL) {
+		if (Headless_Impl::manualClock) {
+			if (Headless_Impl::manualCount < due) Headless_Impl::manualCount = due;
+		}
+		else {
+			INT64 remain = due - Headless_Impl::now();
+			if (remain > 0) {
+				Headless_Impl::wake.wait_for(lock, std::chrono::nanoseconds(remain));
+				continue;
+			}
 		}
 
-		Ref_Impl(unsigned long long refCount) : m_refCount(refCount) {
+		if (fired == nullptr) return WAIT_TIMEOUT;
+		fired->armed = false;
+		return WAIT_OBJECT_0 + index;
+	}
+}
+
+BOOL CloseHandle(HANDLE hObject) {
+	delete static_cast<HeadlessObject*>(hObject);
+	return TRUE;
+}
+
+void YieldProcessor() {
+	if (Headless_Impl::manualClock) Headless_Impl::manualCount += 100;
+}
+
+DWORD GetCurrentThreadId() {
+	return static_cast<DWORD>(std::hash<std::thread::id>()(std::this_thread::get_id()));
+}
+
+int GetSystemMetrics(int nIndex) {
+	switch (nIndex) {
+	case SM_CXSCREEN:
+	case SM_CXVIRTUALSCREEN:
+		return 1920;
+	case SM_CYSCREEN:
+	case SM_CYVIRTUALSCREEN:
+		return 1080;
+	default:
+		return 0;
+	}
+}
+#endif
+
+// IO
+namespace WinFW {
+	namespace IO {
+		void MsgBox::notify(const char *title, const char *body) {
+			MessageBoxA(nullptr, body, title, MB_OK | MB_ICONINFORMATION);
 		}
 
-		unsigned long long numRef() {
-			return m_refCount;
+		void MsgBox::notify(const wchar_t *title, const wchar_t *body) {
+			MessageBoxW(nullptr, body, title, MB_OK | MB_ICONINFORMATION);
 		}
 
-		unsigned long long incRef() {
-			return InterlockedIncrement(&m_refCount);
+		void MsgBox::error(const char *title, const char *body) {
+			MessageBoxA(nullptr, body, title, MB_OK | MB_ICONERROR);
 		}
 
-		unsigned long long decRef() {
-			unsigned long long res = InterlockedDecrement(&m_refCount);
-			if (res == 0) delete this;
-			return res;
+		void MsgBox::error(const wchar_t *title, const wchar_t *body) {
+			MessageBoxW(nullptr, body, title, MB_OK | MB_ICONERROR);
 		}
+	}
+}
 
-		bool delRef() {
-			delete this;
-			return true;
+// EventLoop
+namespace WinFW {
+	// Fixed ring of the last StatsCapacity durations, in seconds. Histogram buckets are 4 per octave of
+	// microseconds : bucket 0 holds everything below 1us, the last bucket everything above its bound.
+	struct TimeRing_Impl {
+		double samples[EventLoop::StatsCapacity];
+		UINT next;
+		UINT count;
+
+		static UINT bucketOf(double time) {
+			double us = time * 1000000.0;
+			if (!(us >= 1.0)) return 0;
+			double index = std::log2(us) * 4.0 + 1.0;
+			if (index >= EventLoop::StatsBuckets - 1) return EventLoop::StatsBuckets - 1;
+			return static_cast<UINT>(index);
 		}
 
-		bool queryRef(void **const ppRef, const char *id, bool cmpByStr) {
-			if (cmpByStr) return queryRefByCmpStr(ppRef, id);
-			else return queryRefByCmpPtr(ppRef, id);
+		void reset() {
+			next = 0;
+			count = 0;
 		}
 
-		const char* getRefName() {
-			return Ref::GetRefName();
+		void push(double time) {
+			samples[next] = time;
+			next = (next + 1) % EventLoop::StatsCapacity;
+			if (count < EventLoop::StatsCapacity) ++count;
 		}
-	};
 
-	class Copyable_Impl : public virtual Copyable, public virtual Ref_Impl {
-		bool setInterface(void **const ppRef) {
-			if (ppRef != nullptr) {
-				incRef();
-				*ppRef = static_cast<Copyable*>(this);
+		TimeStats stats() const {
+			TimeStats result{ count, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 };
+			if (count == 0) return result;
+
+			double sorted[EventLoop::StatsCapacity];
+			double sum = 0.0;
+			for (UINT i = 0; i < count; ++i) {
+				sorted[i] = samples[i];
+				sum += samples[i];
 			}
-			return true;
+			std::sort(sorted, sorted + count);
+
+			auto rank = [&](double p) { return sorted[static_cast<UINT>(std::ceil(p * count)) - 1]; };
+			result.min = sorted[0];
+			result.mean = sum / count;
+			result.p50 = rank(0.50);
+			result.p95 = rank(0.95);
+			result.p99 = rank(0.99);
+			result.max = sorted[count - 1];
+			return result;
+		}
+
+		UINT histogram(UINT *buckets, UINT numBuckets) const {
+			if (buckets == nullptr) return 0;
+			if (numBuckets > EventLoop::StatsBuckets) numBuckets = EventLoop::StatsBuckets;
+			std::fill(buckets, buckets + numBuckets, 0U);
+			for (UINT i = 0; i < count; ++i) {
+				UINT bucket = bucketOf(samples[i]);
+				if (bucket < numBuckets) ++buckets[bucket];
+			}
+			return numBuckets;
 		}
-	protected:
-		bool queryRefByCmpPtr(void **const ppRef, const char *id) {
-			if (id == Copyable::GetRefName()) return setInterface(ppRef);
-			else return Ref_Impl::queryRefByCmpPtr(ppRef, id);
+	};
+
+	// Sees every message EventLoop::isActive retrieves, before it is dispatched.
+	struct MessageSink_Impl {
+		static MessageSink_Impl *first;
+		MessageSink_Impl *m_next;
+		bool m_attached;
+
+		MessageSink_Impl() : m_next(nullptr), m_attached(false) {
 		}
 
-		bool queryRefByCmpStr(void **const ppRef, const char *id) {
-			if (std::strcmp(id, Copyable::GetRefName()) == 0) return setInterface(ppRef);
-			else return Ref_Impl::queryRefByCmpStr(ppRef, id);
+		virtual ~MessageSink_Impl() {
+			detach();
 		}
 
-		virtual bool copyByCmpPtr(void **const ppRef, const char *id) {
-			return queryRefByCmpPtr(ppRef, id);
+		virtual void onMessage(const MSG&) {
 		}
 
-		virtual bool copyByCmpStr(void **const ppRef, const char *id) {
-			return queryRefByCmpStr(ppRef, id);
+		// Raw input reports read in bulk by EventLoop when raw input batching is on.
+		virtual void onRawInput(const RAWINPUT&) {
 		}
-	public:
-		Copyable_Impl() : Copyable_Impl(1ULL) {
+
+		void attach() {
+			if (m_attached) return;
+			m_next = first;
+			first = this;
+			m_attached = true;
 		}
 
-		Copyable_Impl(unsigned long long refCount) : Ref_Impl(refCount) {
+		void detach() {
+			if (!m_attached) return;
+			for (MessageSink_Impl **it = &first; *it != nullptr; it = &(*it)->m_next) {
+				if (*it == this) {
+					*it = m_next;
+					break;
+				}
+			}
+			m_attached = false;
 		}
 
-		const char* getRefName() {
-			return Copyable::GetRefName();
+		static void notify(const MSG &msg) {
+			for (MessageSink_Impl *sink = first; sink != nullptr; sink = sink->m_next) sink->onMessage(msg);
 		}
 
-		bool copy(void **const ppRef, const char *id, bool cmpByStr) {
-			if (cmpByStr) return copyByCmpStr(ppRef, id);
-			else return copyByCmpPtr(ppRef, id);
+		static void notifyRawInput(const RAWINPUT &rawInput) {
+			for (MessageSink_Impl *sink = first; sink != nullptr; sink = sink->m_next) sink->onRawInput(rawInput);
 		}
 	};
 
-	namespace Text {
-		class StringHolder_Impl : public virtual StringHolder, public virtual Copyable_Impl {
-			char *m_str;
-			size_t m_count;
+	MessageSink_Impl *MessageSink_Impl::first = nullptr;
 
-			bool setInterface(void **const ppRef) {
-				if (ppRef != nullptr) {
-					incRef();
-					*ppRef = static_cast<StringHolder*>(this);
-				}
-				return true;
-			}
+	// Windows holding coalesced messages. flushAll runs at the end of every pump (EventLoop::isActive, or the UI
+	// thread's loop) and delivers what each queued window held; a window queued again while flushing waits
+	// for the next pump. The queue is per thread, so a pump only flushes the windows its thread owns and
+	// their handlers run there. merged counts the messages folded into another since EventLoop::resetStats.
+	struct Coalescer_Impl {
+		static std::atomic<bool> enabled;
+		static std::atomic<UINT64> merged;
+		static thread_local UINT current;
+		static thread_local Coalescer_Impl *first;
+		static thread_local Coalescer_Impl *flushing;
+		Coalescer_Impl *m_next;
+		bool m_queued;
 
-			bool copyInterface(void **const ppRef) {
-				if (ppRef != nullptr) {
-					try {
-						size_t countBuff = m_count + 1;
-						char *buff = new char[countBuff];
+		Coalescer_Impl() : m_next(nullptr), m_queued(false) {
+		}
 
-						try {
-							std::memcpy(buff, m_str, countBuff * sizeof(char));
-							*ppRef = static_cast<StringHolder*>(new StringHolder_Impl(buff, m_count));
-						}
-						catch (...) {
-							delete[] buff;
-							return false;
-						}
-					}
-					catch (...) {
-						return false;
-					}
-				}
-				return true;
-			}
-		protected:
-			bool queryRefByCmpPtr(void **const ppRef, const char *id) {
-				if (id == StringHolder::GetRefName()) return setInterface(ppRef);
-				else return Copyable_Impl::queryRefByCmpPtr(ppRef, id);
-			}
+		virtual ~Coalescer_Impl() {
+			dequeue();
+		}
 
-			bool queryRefByCmpStr(void **const ppRef, const char *id) {
-				if (std::strcmp(id, StringHolder::GetRefName()) == 0) return setInterface(ppRef);
-				else return Copyable_Impl::queryRefByCmpStr(ppRef, id);
-			}
+		virtual void flush() = 0;
 
-			bool copyByCmpPtr(void **const ppRef, const char *id) {
-				if (id == StringHolder::GetRefName()) return copyInterface(ppRef);
-				else return Copyable_Impl::copyByCmpPtr(ppRef, id);
-			}
+		void enqueue() {
+			if (m_queued) return;
+			m_next = first;
+			first = this;
+			m_queued = true;
+		}
 
-			bool copyByCmpStr(void **const ppRef, const char *id) {
-				if (std::strcmp(id, StringHolder::GetRefName()) == 0) return copyInterface(ppRef);
-				else return Copyable_Impl::copyByCmpStr(ppRef, id);
-			}
-		public:
-			~StringHolder_Impl() {
-				if (m_str != nullptr) delete[] m_str;
-			}
-
-			StringHolder_Impl(char *str, size_t count) : m_str(str), m_count(count) {
+		bool unlink(Coalescer_Impl **it) {
+			for (; *it != nullptr; it = &(*it)->m_next) {
+				if (*it == this) {
+					*it = m_next;
+					return true;
+				}
 			}
+			return false;
+		}
 
-			const char* getRefName() {
-				return StringHolder::GetRefName();
-			}
+		void dequeue() {
+			if (!m_queued) return;
+			if (!unlink(&first)) unlink(&flushing);
+			m_queued = false;
+		}
 
-			size_t getSize() {
-				return m_count;
+		static void flushAll() {
+			flushing = first;
+			first = nullptr;
+			while (flushing != nullptr) {
+				Coalescer_Impl *coalescer = flushing;
+				flushing = coalescer->m_next;
+				coalescer->m_queued = false;
+				coalescer->flush();
 			}
+		}
+	};
 
-			char* getString() {
-				return m_str;
-			}
+	std::atomic<bool> Coalescer_Impl::enabled(false);
+	std::atomic<UINT64> Coalescer_Impl::merged(0);
+	thread_local UINT Coalescer_Impl::current = 1;
+	thread_local Coalescer_Impl *Coalescer_Impl::first = nullptr;
+	thread_local Coalescer_Impl *Coalescer_Impl::flushing = nullptr;
+
+	// Log layout: Header, then fixed 48-byte Records, little-endian and 8-byte aligned so a log can be
+	// walked in place. A RawInput record carries the report in its own fields, so the log is the same on
+	// x86 and x64 : message = dwType, and for a mouse wParam = usFlags | usButtonFlags << 16 |
+	// usButtonData << 32, lParam = ulRawButtons, ptX / ptY = lLastX / lLastY, msgTime = ulExtraInformation;
+	// for a keyboard wParam = MakeCode | Flags << 16 | VKey << 32, lParam = Message, msgTime = ExtraInformation.
+	struct Recorder_Impl {
+		enum class Mode {
+			None,
+			Record,
+			Replay
 		};
 
-		class WStringHolder_Impl : public virtual WStringHolder, public virtual Copyable_Impl {
-			wchar_t *m_str;
-			size_t m_count;
-
-			bool setInterface(void **const ppRef) {
-				if (ppRef != nullptr) {
-					incRef();
-					*ppRef = static_cast<WStringHolder*>(this);
-				}
-				return true;
-			}
+		enum RecordType : UINT {
+			Loop = 1,
+			Message,
+			RawInput,
+			Fps,
+			Init
+		};
 
-			bool copyInterface(void **const ppRef) {
-				if (ppRef != nullptr) {
-					try {
-						size_t countBuff = m_count + 1;
-						wchar_t *buff = new wchar_t[countBuff];
+		struct Header {
+			char magic[4];
+			UINT version;
+			INT64 cps;
+			INT64 prevLoop;
+			INT64 prevFrame;
+			INT64 tickTime;
+			INT64 tickAccum;
+		};
 
-						try {
-							std::memcpy(buff, m_str, countBuff * sizeof(wchar_t));
-							*ppRef = static_cast<WStringHolder*>(new WStringHolder_Impl(buff, m_count));
-						}
-						catch (...) {
-							delete[] buff;
-							return false;
-						}
-					}
-					catch (...) {
-						return false;
-					}
-				}
-				return true;
-			}
-		protected:
-			bool queryRefByCmpPtr(void **const ppRef, const char *id) {
-				if (id == WStringHolder::GetRefName()) return setInterface(ppRef);
-				else return Copyable_Impl::queryRefByCmpPtr(ppRef, id);
-			}
+		struct Record {
+			UINT type;
+			UINT message;
+			INT64 time;
+			UINT64 wParam;
+			INT64 lParam;
+			UINT msgTime;
+			UINT hWnd;
+			INT ptX;
+			INT ptY;
+		};
 
-			bool queryRefByCmpStr(void **const ppRef, const char *id) {
-				if (std::strcmp(id, WStringHolder::GetRefName()) == 0) return setInterface(ppRef);
-				else return Copyable_Impl::queryRefByCmpStr(ppRef, id);
-			}
+		static_assert(sizeof(Record) == 48, "Recorder record layout");
 
-			bool copyByCmpPtr(void **const ppRef, const char *id) {
-				if (id == WStringHolder::GetRefName()) return copyInterface(ppRef);
-				else return Copyable_Impl::copyByCmpPtr(ppRef, id);
-			}
+		static constexpr UINT version = 2;
+		static Mode mode;
+		static std::FILE *file;
+		static std::mutex windowMutex;
+		static std::vector<HWND> liveWindows;
+		static std::vector<HWND> windows;
+		static std::unordered_map<HWND, UINT> windowIds;
+		static UINT64 count;
+		static RAWINPUT rawInput;
+		static Record pending;
+		static bool hasPending;
 
-			bool copyByCmpStr(void **const ppRef, const char *id) {
-				if (std::strcmp(id, WStringHolder::GetRefName()) == 0) return copyInterface(ppRef);
-				else return Copyable_Impl::copyByCmpStr(ppRef, id);
-			}
-		public:
-			~WStringHolder_Impl() {
-				if (m_str != nullptr) delete[] m_str;
-			}
+		// Window ids are per session : a session numbers the windows alive when it starts in creation order,
+		// then every window created while it runs. A window leaves on WM_NCDESTROY or when its Window is
+		// released, so a reused HWND gets a new id. Window procedures may run on the UI thread, hence the lock.
+		static void registerWindow(HWND hWnd) {
+			windows.push_back(hWnd);
+			windowIds[hWnd] = static_cast<UINT>(windows.size());
+		}
 
-			WStringHolder_Impl(wchar_t *str, size_t count) : m_str(str), m_count(count) {
-			}
+		static void addWindow(HWND hWnd) {
+			if (hWnd == nullptr) return;
+			std::lock_guard<std::mutex> lock(windowMutex);
+			liveWindows.push_back(hWnd);
+			if (mode != Mode::None) registerWindow(hWnd);
+		}
 
-			const char* getRefName() {
-				return WStringHolder::GetRefName();
-			}
+		static void removeWindow(HWND hWnd) {
+			std::lock_guard<std::mutex> lock(windowMutex);
+			auto live = std::find(liveWindows.begin(), liveWindows.end(), hWnd);
+			if (live != liveWindows.end()) liveWindows.erase(live);
+			auto it = windowIds.find(hWnd);
+			if (it == windowIds.end()) return;
+			windows[it->second - 1] = nullptr;
+			windowIds.erase(it);
+		}
 
-			size_t getSize() {
-				return m_count;
-			}
+		static void beginSession() {
+			std::lock_guard<std::mutex> lock(windowMutex);
+			windows.clear();
+			windowIds.clear();
+			for (HWND hWnd : liveWindows) registerWindow(hWnd);
+		}
 
-			wchar_t* getWString() {
-				return m_str;
-			}
-		};
-	}
+		static UINT windowId(HWND hWnd) {
+			if (hWnd == nullptr) return 0;
+			std::lock_guard<std::mutex> lock(windowMutex);
+			auto it = windowIds.find(hWnd);
+			return it == windowIds.end() ? 0 : it->second;
+		}
 
-	namespace Exception {
-		class Exception_Impl : public virtual Exception, public virtual Ref_Impl {
-			Text::StringHolder *m_msg;
+		static HWND window(UINT id) {
+			std::lock_guard<std::mutex> lock(windowMutex);
+			return id == 0 || id > windows.size() ? nullptr : windows[id - 1];
+		}
 
-			bool setInterface(void **const ppRef) {
-				if (ppRef != nullptr) {
-					incRef();
-					*ppRef = static_cast<Exception*>(this);
-				}
-				return true;
-			}
-		protected:
-			bool queryRefByCmpPtr(void **const ppRef, const char *id) {
-				if (id == Exception::GetRefName()) return setInterface(ppRef);
-				else return Ref_Impl::queryRefByCmpPtr(ppRef, id);
-			}
+		static INT64 now() {
+			INT64 res;
+			QueryPerformanceCounter(reinterpret_cast<LARGE_INTEGER*>(&res));
+			return res;
+		}
 
-			bool queryRefByCmpStr(void **const ppRef, const char *id) {
-				if (std::strcmp(id, Exception::GetRefName()) == 0) return setInterface(ppRef);
-				else return Ref_Impl::queryRefByCmpStr(ppRef, id);
+		static std::FILE* open(const char *path, const char *openMode) {
+#ifdef _MSC_VER
+			std::FILE *res = nullptr;
+			if (fopen_s(&res, path, openMode) != 0) return nullptr;
+			return res;
+#else
+			return std::fopen(path, openMode);
+#endif
+		}
+
+		static void write(const Record &record) {
+			std::fwrite(&record, sizeof(record), 1, file);
+			++count;
+		}
+
+		// Painting, and messages whose lParam may point into this process : a WM_TIMER with a TIMERPROC and
+		// application-defined messages. They are not logged, and while replaying they are the only live
+		// messages still dispatched, since the running process produces them again.
+		static bool isLocal(const MSG &msg) {
+			return msg.message == WM_PAINT || msg.message >= WM_USER || (msg.message == WM_TIMER && msg.lParam != 0);
+		}
+
+		static void writeLoop(INT64 time) {
+			Record record{};
+			record.type = Loop;
+			record.time = time;
+			write(record);
+		}
+
+		static void writeMessage(const MSG &msg) {
+			if (isLocal(msg)) return;
+			Record record{};
+			record.type = Message;
+			record.message = msg.message;
+			record.time = now();
+			record.wParam = msg.wParam;
+			record.lParam = msg.lParam;
+			record.msgTime = msg.time;
+			record.hWnd = windowId(msg.hwnd);
+			record.ptX = msg.pt.x;
+			record.ptY = msg.pt.y;
+			write(record);
+		}
+
+		static void writeRawInput(const RAWINPUT &input) {
+			Record record{};
+			record.type = RawInput;
+			record.message = input.header.dwType;
+			record.time = now();
+			if (input.header.dwType == RIM_TYPEMOUSE) {
+				const RAWMOUSE &mouse = input.data.mouse;
+				record.wParam = mouse.usFlags | static_cast<UINT64>(mouse.usButtonFlags) << 16 | static_cast<UINT64>(mouse.usButtonData) << 32;
+				record.lParam = mouse.ulRawButtons;
+				record.ptX = mouse.lLastX;
+				record.ptY = mouse.lLastY;
+				record.msgTime = mouse.ulExtraInformation;
 			}
-		public:
-			~Exception_Impl() {
-				m_msg->decRef();
+			else if (input.header.dwType == RIM_TYPEKEYBOARD) {
+				const RAWKEYBOARD &keyboard = input.data.keyboard;
+				record.wParam = keyboard.MakeCode | static_cast<UINT64>(keyboard.Flags) << 16 | static_cast<UINT64>(keyboard.VKey) << 32;
+				record.lParam = keyboard.Message;
+				record.msgTime = keyboard.ExtraInformation;
 			}
-
-			Exception_Impl(Text::StringHolder *msg) : m_msg(msg) {
+			write(record);
+		}
+
+		static void toRawInput(const Record &record) {
+			rawInput = {};
+			rawInput.header.dwType = record.message;
+			rawInput.header.dwSize = sizeof(RAWINPUT);
+			if (record.message == RIM_TYPEMOUSE) {
+				RAWMOUSE &mouse = rawInput.data.mouse;
+				mouse.usFlags = static_cast<USHORT>(record.wParam);
+				mouse.usButtonFlags = static_cast<USHORT>(record.wParam >> 16);
+				mouse.usButtonData = static_cast<USHORT>(record.wParam >> 32);
+				mouse.ulRawButtons = static_cast<ULONG>(record.lParam);
+				mouse.lLastX = record.ptX;
+				mouse.lLastY = record.ptY;
+				mouse.ulExtraInformation = record.msgTime;
 			}
-
-			const char* getRefName() const {
-				return Exception::GetRefName();
+			else if (record.message == RIM_TYPEKEYBOARD) {
+				RAWKEYBOARD &keyboard = rawInput.data.keyboard;
+				keyboard.MakeCode = static_cast<USHORT>(record.wParam);
+				keyboard.Flags = static_cast<USHORT>(record.wParam >> 16);
+				keyboard.VKey = static_cast<USHORT>(record.wParam >> 32);
+				keyboard.Message = static_cast<UINT>(record.lParam);
+				keyboard.ExtraInformation = record.msgTime;
 			}
+		}
 
-			const char* getMsg() {
-				return m_msg->getString();
-			}
+		static void writeFps(UINT fps, bool res) {
+			Record record{};
+			record.type = Fps;
+			record.message = fps;
+			record.wParam = res ? 1 : 0;
+			write(record);
+		}
 
-			void showMsg() {
-				IO::MsgBox::error("Exception", m_msg->getString());
-			}
-		};
+		static void writeInit(INT64 time) {
+			Record record{};
+			record.type = Init;
+			record.time = time;
+			write(record);
+		}
 
-		class InvalidObjectException_Impl : public virtual InvalidObjectException, public virtual Exception_Impl {
-			bool setInterface(void **const ppRef) {
-				if (ppRef != nullptr) {
-					incRef();
-					*ppRef = static_cast<InvalidObjectException*>(this);
-				}
+		static bool read(Record &record) {
+			if (hasPending) {
+				record = pending;
+				hasPending = false;
 				return true;
 			}
-		protected:
-			bool queryRefByCmpPtr(void **const ppRef, const char *id) {
-				if (id == InvalidObjectException::GetRefName()) return setInterface(ppRef);
-				else return Exception_Impl::queryRefByCmpPtr(ppRef, id);
-			}
-
-			bool queryRefByCmpStr(void **const ppRef, const char *id) {
-				if (std::strcmp(id, InvalidObjectException::GetRefName()) == 0) return setInterface(ppRef);
-				else return Exception_Impl::queryRefByCmpStr(ppRef, id);
-			}
-		public:
-			InvalidObjectException_Impl(Text::StringHolder *msg) : Exception_Impl(msg) {
-			}
-
-			const char* getRefName() const {
-				return InvalidObjectException::GetRefName();
-			}
-
-			void showMsg() {
-				IO::MsgBox::error("InvalidObject", getMsg());
-			}
-		};
-	}
-
-	class WinClassStyle_Impl : public virtual WinClassStyle, public virtual Copyable_Impl {
-		UINT m_value = 0;
-
-		bool setInterface(void **const ppRef) {
-			if (ppRef != nullptr) {
-				incRef();
-				*ppRef = static_cast<WinClassStyle*>(this);
-			}
+			if (std::fread(&record, sizeof(record), 1, file) != 1) return false;
+			if (record.type == RawInput) toRawInput(record);
+			++count;
 			return true;
 		}
 
-		bool copyInterface(void **const ppRef) {
-			if (ppRef != nullptr) {
-				try {
-					*ppRef = static_cast<WinClassStyle*>(new WinClassStyle_Impl(m_value));
-				}
-				catch (...) {
-					return false;
-				}
+		static bool peek(Record &record) {
+			if (!hasPending) {
+				if (!read(pending)) return false;
+				hasPending = true;
 			}
+			record = pending;
 			return true;
 		}
-	protected:
-		bool queryRefByCmpPtr(void **const ppRef, const char *id) {
-			if (id == WinClassStyle::GetRefName()) return setInterface(ppRef);
-			else return Copyable_Impl::queryRefByCmpPtr(ppRef, id);
+
+		static MSG toMsg(const Record &record) {
+			MSG msg{};
+			msg.hwnd = window(record.hWnd);
+			msg.message = record.message;
+			msg.wParam = static_cast<WPARAM>(record.wParam);
+			msg.lParam = static_cast<LPARAM>(record.lParam);
+			msg.time = record.msgTime;
+			msg.pt.x = record.ptX;
+			msg.pt.y = record.ptY;
+			return msg;
 		}
 
-		bool queryRefByCmpStr(void **const ppRef, const char *id) {
-			if (std::strcmp(id, WinClassStyle::GetRefName()) == 0) return setInterface(ppRef);
-			else return Copyable_Impl::queryRefByCmpStr(ppRef, id);
+		static void close() {
+			if (file != nullptr) std::fclose(file);
+			file = nullptr;
+			mode = Mode::None;
+			hasPending = false;
 		}
+	};
+
+	Recorder_Impl::Mode Recorder_Impl::mode = Recorder_Impl::Mode::None;
+	std::FILE *Recorder_Impl::file = nullptr;
+	std::mutex Recorder_Impl::windowMutex;
+	std::vector<HWND> Recorder_Impl::liveWindows;
+	std::vector<HWND> Recorder_Impl::windows;
+	std::unordered_map<HWND, UINT> Recorder_Impl::windowIds;
+	UINT64 Recorder_Impl::count = 0;
+	RAWINPUT Recorder_Impl::rawInput = {};
+	Recorder_Impl::Record Recorder_Impl::pending = {};
+	bool Recorder_Impl::hasPending = false;
+
+	// Single producer / single consumer ring over a power of two capacity. The producer fills back() and
+	// publishes it with push(); the consumer reads front() and releases it with pop().
+	template<typename T>
+	struct SpscRing_Impl {
+		std::vector<T> slots;
+		UINT mask;
+		std::atomic<UINT> head;
+		char pad[64];
+		std::atomic<UINT> tail;
 
-		bool copyByCmpPtr(void **const ppRef, const char *id) {
-			if (id == WinClassStyle::GetRefName()) return copyInterface(ppRef);
-			else return Copyable_Impl::copyByCmpPtr(ppRef, id);
+		SpscRing_Impl() : mask(0), head(0), pad{}, tail(0) {
 		}
 
-		bool copyByCmpStr(void **const ppRef, const char *id) {
-			if (std::strcmp(id, WinClassStyle::GetRefName()) == 0) return copyInterface(ppRef);
-			else return Copyable_Impl::copyByCmpStr(ppRef, id);
+		void init(UINT capacity) {
+			UINT size = 2;
+			while (size < capacity && size < (1U << 30)) size <<= 1;
+			slots.assign(size, T{});
+			mask = size - 1;
+			head.store(0, std::memory_order_relaxed);
+			tail.store(0, std::memory_order_relaxed);
 		}
-	public:
-		static const char* GetRefName() {
-			return "WinFW::WinClassStyle_Impl";
+
+		T* back() {
+			UINT tailIndex = tail.load(std::memory_order_relaxed);
+			if (tailIndex - head.load(std::memory_order_acquire) > mask) return nullptr;
+			return &slots[tailIndex & mask];
 		}
 
-		WinClassStyle_Impl() : WinClassStyle_Impl(0) {
+		void push() {
+			tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
 		}
 
-		WinClassStyle_Impl(UINT value) : m_value(value) {
+		T* front() {
+			UINT headIndex = head.load(std::memory_order_relaxed);
+			if (headIndex == tail.load(std::memory_order_acquire)) return nullptr;
+			return &slots[headIndex & mask];
 		}
 
-		const char* getRefName() const {
-			return WinClassStyle::GetRefName();
+		void pop() {
+			head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
 		}
+	};
 
-		virtual UINT getValue() {
-			return m_value;
+	// Windows created while the UI thread runs belong to it. It forwards every message it retrieves to the
+	// app thread through events, and runs what the app thread queues in commands; wake is set on every
+	// command so the UI thread can block in MsgWaitForMultipleObjectsEx. Commands come from the app thread
+	// only. A command queued while the UI thread sits in a modal move / size loop runs when the loop ends.
+	struct UIThread_Impl {
+		enum class CommandType : BYTE {
+			Call,
+			SetTitle,
+			Show,
+			Update,
+			SetPos,
+			Quit
+		};
+
+		struct Command {
+			CommandType type;
+			HWND hWnd;
+			int x;
+			int y;
+			int cx;
+			int cy;
+			UINT flags;
+			Text::WStringHolder *title;
+			void (*func)(void*);
+			void *ctx;
+			bool *done;
+		};
+
+		// WM_INPUT carries its report, since the raw input handle is gone once the UI thread dispatched it.
+		struct Event {
+			MSG msg;
+			bool isRaw;
+			RAWINPUT rawInput;
+		};
+
+		struct CreateWindowArgs {
+			DWORD exStyle;
+			LPCWSTR className;
+			LPCWSTR title;
+			DWORD style;
+			int x;
+			int y;
+			int width;
+			int height;
+			HWND parent;
+			HMENU menu;
+			LPVOID param;
+			HWND hWnd;
+		};
+
+		static std::atomic<bool> running;
+		static thread_local bool current;
+		static std::thread *thread;
+		static HANDLE wake;
+		static HANDLE appWake;
+		static SpscRing_Impl<Event> events;
+		static SpscRing_Impl<Command> commands;
+		static std::atomic<UINT64> dropped;
+		static std::mutex callMutex;
+		static std::condition_variable callDone;
+
+		static bool isRunning() {
+			return running.load(std::memory_order_acquire);
 		}
 
-		WinClassStyle* clear() {
-			m_value = 0;
-			return this;
+		static bool isRemote() {
+			return !current && isRunning();
 		}
 
-		WinClassStyle* VRedraw() {
-			m_value |= CS_VREDRAW;
-			return this;
+		// A full command queue waits for the UI thread to catch up rather than losing a command.
+		static Command* command(CommandType type, HWND hWnd) {
+			Command *res;
+			while ((res = commands.back()) == nullptr) std::this_thread::yield();
+			*res = {};
+			res->type = type;
+			res->hWnd = hWnd;
+			return res;
 		}
 
-		WinClassStyle* HRedraw() {
-			m_value |= CS_HREDRAW;
-			return this;
+		static void submit() {
+			commands.push();
+			SetEvent(wake);
 		}
 
-		WinClassStyle* DBLCLKS() {
-			m_value |= CS_DBLCLKS;
-			return this;
+		// Runs func on the UI thread and sleeps until it ran, or runs it in place when there is no other UI thread.
+		static void call(void (*func)(void*), void *ctx) {
+			if (!isRemote()) {
+				func(ctx);
+				return;
+			}
+
+			bool done = false;
+			Command *res = command(CommandType::Call, nullptr);
+			res->func = func;
+			res->ctx = ctx;
+			res->done = &done;
+			submit();
+
+			std::unique_lock<std::mutex> lock(callMutex);
+			callDone.wait(lock, [&done]() { return done; });
 		}
 
-		WinClassStyle* OwnDC() {
-			m_value |= CS_OWNDC;
-			return this;
+		// Queues func for the UI thread without waiting, or runs it in place when there is no other UI thread.
+		static void post(void (*func)(void*), void *ctx) {
+			if (!isRemote()) {
+				func(ctx);
+				return;
+			}
+
+			Command *res = command(CommandType::Call, nullptr);
+			res->func = func;
+			res->ctx = ctx;
+			submit();
 		}
 
-		WinClassStyle* ClassDC() {
-			m_value |= CS_CLASSDC;
-			return this;
+		static BOOL setTitle(HWND hWnd, LPCWSTR title) {
+			Text::WStringHolder *holder = Text::WStringHolder::New(title == nullptr ? L"" : title);
+			if (holder == nullptr) return FALSE;
+			command(CommandType::SetTitle, hWnd)->title = holder;
+			submit();
+			return TRUE;
 		}
 
-		WinClassStyle* ParentDC() {
-			m_value |= CS_PARENTDC;
-			return this;
+		static BOOL show(HWND hWnd, int nCmdShow) {
+			command(CommandType::Show, hWnd)->x = nCmdShow;
+			submit();
+			return TRUE;
 		}
 
-		WinClassStyle* NoClose() {
-			m_value |= CS_NOCLOSE;
-			return this;
+		static BOOL update(HWND hWnd) {
+			command(CommandType::Update, hWnd);
+			submit();
+			return TRUE;
 		}
 
-		WinClassStyle* SaveBits() {
-			m_value |= CS_SAVEBITS;
-			return this;
+		static BOOL setPos(HWND hWnd, int x, int y, int cx, int cy, UINT flags) {
+			Command *res = command(CommandType::SetPos, hWnd);
+			res->x = x;
+			res->y = y;
+			res->cx = cx;
+			res->cy = cy;
+			res->flags = flags;
+			submit();
+			return TRUE;
 		}
 
-		WinClassStyle* ByteAlignClient() {
-			m_value |= CS_BYTEALIGNCLIENT;
-			return this;
+		static void createWindowProc(void *ctx) {
+			CreateWindowArgs *args = static_cast<CreateWindowArgs*>(ctx);
+			args->hWnd = CreateWindowExW(args->exStyle, args->className, args->title, args->style, args->x, args->y,
+				args->width, args->height, args->parent, args->menu, g_hInstance, args->param);
 		}
 
-		WinClassStyle* ByteAlignWindow() {
-			m_value |= CS_BYTEALIGNWINDOW;
-			return this;
+		static HWND createWindow(DWORD exStyle, LPCWSTR className, LPCWSTR title, DWORD style, int x, int y, int width, int height,
+			HWND parent, HMENU menu, LPVOID param) {
+			CreateWindowArgs args{ exStyle, className, title, style, x, y, width, height, parent, menu, param, nullptr };
+			call(&createWindowProc, &args);
+			return args.hWnd;
 		}
 
-		WinClassStyle* GlobalClass() {
-			m_value |= CS_GLOBALCLASS;
-			return this;
+		static void dispatchProc(void *ctx) {
+			MSG *msg = static_cast<MSG*>(ctx);
+			TranslateMessage(msg);
+			DispatchMessageW(msg);
 		}
 
-		WinClassStyle* DropShadow() {
-			m_value |= CS_DROPSHADOW;
-			return this;
+		// Dispatches msg on the thread that owns its window, waiting for the UI thread when that is the owner.
+		static void dispatch(MSG &msg) {
+			if (msg.hwnd != nullptr && isRemote() && GetWindowThreadProcessId(msg.hwnd, nullptr) != GetCurrentThreadId()) {
+				call(&dispatchProc, &msg);
+				return;
+			}
+			dispatchProc(&msg);
 		}
-	};
 
-	class WinClassConfig_Impl : public virtual WinClassConfig, public virtual Copyable_Impl {
-		UINT m_style;
-		int	m_cbClsExtra;
-		int	m_cbWndExtra;
-		HICON m_hIcon;
-		HCURSOR	m_hCursor;
-		HBRUSH m_hbrBackground;
-		HICON m_hIconSm;
-		Text::WStringHolder *m_lpszMenuName;
-		Text::WStringHolder *m_lpszClassName;
-		WNDPROC m_lpfnWndProc;
+		static void forward(const MSG &msg) {
+			Event *event = events.back();
+			if (event == nullptr) {
+				dropped.fetch_add(1, std::memory_order_relaxed);
+				return;
+			}
 
-		bool setInterface(void **const ppRef) {
-			if (ppRef != nullptr) {
-				incRef();
-				*ppRef = static_cast<WinClassConfig*>(this);
+			event->msg = msg;
+			event->isRaw = msg.message == WM_INPUT;
+			if (event->isRaw) {
+				UINT size = sizeof(event->rawInput);
+				if (GetRawInputData(reinterpret_cast<HRAWINPUT>(msg.lParam), RID_INPUT, &event->rawInput, &size, sizeof(RAWINPUTHEADER)) == static_cast<UINT>(-1)) return;
+			}
+			events.push();
+			SetEvent(appWake);
+		}
+
+		// Returns false once the quit command ran.
+		static bool execute(const Command &command) {
+			switch (command.type) {
+			case CommandType::Call:
+				command.func(command.ctx);
+				if (command.done != nullptr) {
+					{
+						std::lock_guard<std::mutex> lock(callMutex);
+						*command.done = true;
+					}
+					callDone.notify_all();
+				}
+				break;
+			case CommandType::SetTitle:
+				SetWindowTextW(command.hWnd, command.title->getWString());
+				command.title->decRef();
+				break;
+			case CommandType::Show:
+				ShowWindow(command.hWnd, command.x);
+				break;
+			case CommandType::Update:
+				UpdateWindow(command.hWnd);
+				break;
+			case CommandType::SetPos:
+				SetWindowPos(command.hWnd, nullptr, command.x, command.y, command.cx, command.cy, command.flags);
+				break;
+			case CommandType::Quit:
+				return false;
 			}
 			return true;
 		}
 
-		bool copyInterface(void **const ppRef) {
-			if (ppRef != nullptr) {
-				try {
-					m_lpszClassName->incRef();
-					m_lpszMenuName->incRef();
-					*ppRef = static_cast<WinClassConfig*>(new WinClassConfig_Impl(m_style, m_cbClsExtra, m_cbWndExtra, m_hIcon, m_hCursor,
-						m_hbrBackground, m_hIconSm, m_lpszMenuName, m_lpszClassName, m_lpfnWndProc));
+		static void run() {
+			current = true;
+			MSG msg;
+			for (;;) {
+				Command *res;
+				while ((res = commands.front()) != nullptr) {
+					bool keepRunning = execute(*res);
+					commands.pop();
+					if (!keepRunning) return;
 				}
-				catch (...) {
-					m_lpszClassName->decRef();
-					m_lpszMenuName->decRef();
-					return false;
+
+				while (PeekMessageW(&msg, nullptr, 0, 0, PM_REMOVE)) {
+					forward(msg);
+					TranslateMessage(&msg);
+					DispatchMessageW(&msg);
 				}
+				if (Coalescer_Impl::first != nullptr) Coalescer_Impl::flushAll();
+
+				MsgWaitForMultipleObjectsEx(1, &wake, INFINITE, QS_ALLINPUT, MWMO_INPUTAVAILABLE);
 			}
-			return true;
 		}
-	protected:
-		bool queryRefByCmpPtr(void **const ppRef, const char *id) {
-			if (id == WinClassConfig::GetRefName()) return setInterface(ppRef);
-			else if (id == WinClassConfig_Impl::GetRefName()) {
-				if (ppRef != nullptr) *ppRef = this;
-				return true;
+
+		static void discard() {
+			while (events.front() != nullptr) events.pop();
+		}
+	};
+
+	std::atomic<bool> UIThread_Impl::running(false);
+	thread_local bool UIThread_Impl::current = false;
+	std::thread *UIThread_Impl::thread = nullptr;
+	HANDLE UIThread_Impl::wake = nullptr;
+	HANDLE UIThread_Impl::appWake = nullptr;
+	SpscRing_Impl<UIThread_Impl::Event> UIThread_Impl::events;
+	SpscRing_Impl<UIThread_Impl::Command> UIThread_Impl::commands;
+	std::atomic<UINT64> UIThread_Impl::dropped(0);
+	std::mutex UIThread_Impl::callMutex;
+	std::condition_variable UIThread_Impl::callDone;
+
+	// Coroutine frames : 64-byte size classes up to 2 KB, carved from 64 KB chunks and recycled through per
+	// class free lists. Chunks stay for the life of the process; larger frames go to operator new.
+	struct CoroutineArena_Impl {
+		static constexpr size_t granularity = 64;
+		static constexpr size_t numClasses = 32;
+		static constexpr size_t chunkSize = 64 * 1024;
+
+		struct Block {
+			Block *next;
+		};
+
+		static std::mutex mutex;
+		static Block *heads[numClasses];
+		static Block *chunks;
+		static size_t chunkUsed;
+
+		static void* allocate(size_t size) {
+			size_t index = (size - 1) / granularity;
+			if (index >= numClasses) return ::operator new(size);
+
+			std::lock_guard<std::mutex> lock(mutex);
+			Block *block = heads[index];
+			if (block != nullptr) {
+				heads[index] = block->next;
+				return block;
+			}
+
+			size_t blockSize = (index + 1) * granularity;
+			if (chunks == nullptr || chunkUsed + blockSize > chunkSize) {
+				Block *chunk = static_cast<Block*>(::operator new(chunkSize));
+				chunk->next = chunks;
+				chunks = chunk;
+				chunkUsed = granularity;
 			}
-			else return Copyable_Impl::queryRefByCmpPtr(ppRef, id);
+			void *res = reinterpret_cast<char*>(chunks) + chunkUsed;
+			chunkUsed += blockSize;
+			return res;
 		}
 
-		bool queryRefByCmpStr(void **const ppRef, const char *id) {
-			if (std::strcmp(id, WinClassConfig::GetRefName()) == 0) return setInterface(ppRef);
-			else return Copyable_Impl::queryRefByCmpStr(ppRef, id);
+		static void release(void *ptr, size_t size) {
+			if (ptr == nullptr) return;
+			size_t index = (size - 1) / granularity;
+			if (index >= numClasses) {
+				::operator delete(ptr);
+				return;
+			}
+
+			std::lock_guard<std::mutex> lock(mutex);
+			Block *block = static_cast<Block*>(ptr);
+			block->next = heads[index];
+			heads[index] = block;
 		}
+	};
+
+	std::mutex CoroutineArena_Impl::mutex;
+	CoroutineArena_Impl::Block *CoroutineArena_Impl::heads[CoroutineArena_Impl::numClasses] = {};
+	CoroutineArena_Impl::Block *CoroutineArena_Impl::chunks = nullptr;
+	size_t CoroutineArena_Impl::chunkUsed = 0;
+
+	// Waiters of each kind are moved out before they run, so a callback that queues itself again waits for
+	// the next frame / press instead of running twice. Delays sit in a min-heap on their due count, so an
+	// idle loop only looks at the earliest one. The instance is the sink that sees key presses.
+	struct Coroutine_Impl : MessageSink_Impl {
+		struct Waiter {
+			JobFunc func;
+			void *ctx;
+		};
+
+		struct Timed {
+			INT64 due;
+			UINT64 order;
+			Waiter waiter;
+		};
 
-		bool copyByCmpPtr(void **const ppRef, const char *id) {
-			if (id == WinClassConfig::GetRefName()) return copyInterface(ppRef);
-			else return Copyable_Impl::copyByCmpPtr(ppRef, id);
+		static Coroutine_Impl sink;
+		static std::vector<Waiter> frameWaiters;
+		static std::vector<Waiter> frameResuming;
+		static std::vector<Timed> timed;
+		static std::vector<Waiter> keyWaiters[256];
+		static std::vector<Waiter> keyResuming;
+		static KeyMask waitingKeys;
+		static KeyMask heldKeys;
+		static KeyMask pressedKeys;
+		static UINT64 order;
+		static UINT suspended;
+
+		static bool later(const Timed &a, const Timed &b) {
+			return a.due != b.due ? a.due > b.due : a.order > b.order;
+		}
+
+		static void keyDown(BYTE vKey) {
+			if (heldKeys.test(vKey)) return;
+			heldKeys.bits[vKey >> 6] |= 1ULL << (vKey & 63);
+			pressedKeys.bits[vKey >> 6] |= 1ULL << (vKey & 63);
+		}
+
+		static void keyUp(BYTE vKey) {
+			heldKeys.bits[vKey >> 6] &= ~(1ULL << (vKey & 63));
+		}
+
+		void onMessage(const MSG &msg) {
+			switch (msg.message) {
+			case WM_KEYDOWN:
+			case WM_SYSKEYDOWN:
+				keyDown(static_cast<BYTE>(msg.wParam));
+				break;
+			case WM_KEYUP:
+			case WM_SYSKEYUP:
+				keyUp(static_cast<BYTE>(msg.wParam));
+				break;
+			case WM_KILLFOCUS:
+				heldKeys = {};
+				break;
+			default:
+				break;
+			}
 		}
 
-		bool copyByCmpStr(void **const ppRef, const char *id) {
-			if (std::strcmp(id, WinClassConfig::GetRefName()) == 0) return copyInterface(ppRef);
-			else return Copyable_Impl::copyByCmpStr(ppRef, id);
+		void onRawInput(const RAWINPUT &rawInput) {
+			if (rawInput.header.dwType != RIM_TYPEKEYBOARD || rawInput.data.keyboard.VKey >= 256) return;
+			BYTE vKey = static_cast<BYTE>(rawInput.data.keyboard.VKey);
+			if (rawInput.data.keyboard.Flags & RI_KEY_BREAK) keyUp(vKey);
+			else keyDown(vKey);
 		}
-	public:
-		static const char* GetRefName() {
-			return "WinFW::WinClassConfig_Impl";
+
+		static void addTimed(INT64 due, JobFunc func, void *ctx) {
+			timed.push_back({ due, order++, { func, ctx } });
+			std::push_heap(timed.begin(), timed.end(), &later);
+			++suspended;
 		}
 
-		~WinClassConfig_Impl() {
-			m_lpszMenuName->decRef();
-			m_lpszClassName->decRef();
+		static void addKey(BYTE vKey, JobFunc func, void *ctx) {
+			keyWaiters[vKey].push_back({ func, ctx });
+			waitingKeys.bits[vKey >> 6] |= 1ULL << (vKey & 63);
+			sink.attach();
+			++suspended;
 		}
 
-		WinClassConfig_Impl(Text::WStringHolder *lpszClassName, WNDPROC lpfnWndProc) : WinClassConfig_Impl(CS_HREDRAW | CS_VREDRAW, 0, 0, nullptr, 
-			LoadCursorW(NULL, IDC_ARROW), reinterpret_cast<HBRUSH>(COLOR_WINDOW + 1), nullptr, Text::WStringHolder::New(nullptr),
-			lpszClassName, lpfnWndProc) {
+		static void resume(std::vector<Waiter> &waiters, std::vector<Waiter> &resuming) {
+			resuming.swap(waiters);
+			suspended -= static_cast<UINT>(resuming.size());
+			for (const Waiter &waiter : resuming) waiter.func(waiter.ctx);
+			resuming.clear();
+		}
+
+		static void resumeFrame() {
+			if (!frameWaiters.empty()) resume(frameWaiters, frameResuming);
+		}
+
+		static void resumeLoop(INT64 now) {
+			while (!timed.empty() && timed.front().due <= now) {
+				std::pop_heap(timed.begin(), timed.end(), &later);
+				Waiter waiter = timed.back().waiter;
+				timed.pop_back();
+				--suspended;
+				waiter.func(waiter.ctx);
+			}
+
+			if (!pressedKeys.any()) return;
+			KeyMask hit;
+			for (UINT i = 0; i < 4; ++i) hit.bits[i] = pressedKeys.bits[i] & waitingKeys.bits[i];
+			pressedKeys = {};
+			hit.forEach([](BYTE vKey) {
+				waitingKeys.bits[vKey >> 6] &= ~(1ULL << (vKey & 63));
+				resume(keyWaiters[vKey], keyResuming);
+			});
+		}
+	};
+
+	Coroutine_Impl Coroutine_Impl::sink;
+	std::vector<Coroutine_Impl::Waiter> Coroutine_Impl::frameWaiters;
+	std::vector<Coroutine_Impl::Waiter> Coroutine_Impl::frameResuming;
+	std::vector<Coroutine_Impl::Timed> Coroutine_Impl::timed;
+	std::vector<Coroutine_Impl::Waiter> Coroutine_Impl::keyWaiters[256];
+	std::vector<Coroutine_Impl::Waiter> Coroutine_Impl::keyResuming;
+	KeyMask Coroutine_Impl::waitingKeys = {};
+	KeyMask Coroutine_Impl::heldKeys = {};
+	KeyMask Coroutine_Impl::pressedKeys = {};
+	UINT64 Coroutine_Impl::order = 0;
+	UINT Coroutine_Impl::suspended = 0;
+
+	// Hierarchical timing wheel : numLevels levels of 256 slots over 1 ms ticks of the QPC clock. A timer sits
+	// at the level of the highest byte where its due tick differs from current, so level 0 only holds the
+	// current 256-tick block. Crossing a block boundary cascades the matching slot of the level above, and
+	// the occupancy masks let advance jump straight to the next non-empty slot. Nodes are pooled by index,
+	// index 0 standing for none; an ID is (generation << 32) | index, so cancel is O(1) and ignores stale IDs.
+	struct Timer_Impl {
+		static constexpr UINT numLevels = 6;
+		static constexpr UINT none = 0;
+
+		struct Node {
+			INT64 due;
+			INT64 period;
+			UINT64 dueTick;
+			JobFunc func;
+			void *ctx;
+			UINT prev;
+			UINT next;
+			UINT generation;
+			BYTE level;
+			BYTE slot;
+			bool active;
+		};
+
+		static std::vector<Node> nodes;
+		static UINT freeList;
+		static UINT heads[numLevels][256];
+		static KeyMask occupied[numLevels];
+		static UINT64 current;
+		static INT64 tickCount;
+		static UINT pending;
+
+		// The wheel is rebased on the loop time whenever it runs empty.
+		static void init(INT64 cps, INT64 now) {
+			if (nodes.empty()) nodes.push_back({});
+			tickCount = cps >= 1000 ? cps / 1000 : 1;
+			current = static_cast<UINT64>(now / tickCount);
+		}
+
+		static void setBit(KeyMask &mask, UINT slot, bool value) {
+			if (value) mask.bits[slot >> 6] |= 1ULL << (slot & 63);
+			else mask.bits[slot >> 6] &= ~(1ULL << (slot & 63));
+		}
+
+		static void link(UINT index) {
+			Node &node = nodes[index];
+			if (node.dueTick <= current) node.dueTick = current + 1;
+
+			UINT64 diff = node.dueTick ^ current;
+			UINT level = 0;
+			while (level < numLevels - 1 && (diff >> (8 * (level + 1))) != 0) ++level;
+			UINT slot = static_cast<UINT>(node.dueTick >> (8 * level)) & 255;
+
+			node.level = static_cast<BYTE>(level);
+			node.slot = static_cast<BYTE>(slot);
+			node.prev = none;
+			node.next = heads[level][slot];
+			if (node.next != none) nodes[node.next].prev = index;
+			heads[level][slot] = index;
+			setBit(occupied[level], slot, true);
+		}
+
+		static void unlink(UINT index) {
+			Node &node = nodes[index];
+			if (node.prev != none) nodes[node.prev].next = node.next;
+			else heads[node.level][node.slot] = node.next;
+			if (node.next != none) nodes[node.next].prev = node.prev;
+			if (heads[node.level][node.slot] == none) setBit(occupied[node.level], node.slot, false);
+		}
+
+		static void free(UINT index) {
+			Node &node = nodes[index];
+			node.active = false;
+			++node.generation;
+			node.next = freeList;
+			freeList = index;
+			--pending;
+		}
+
+		// Due ticks round up, so a timer never fires before its due count.
+		static UINT64 add(INT64 cps, INT64 now, INT64 due, INT64 period, JobFunc func, void *ctx) {
+			if (pending == 0) init(cps, now);
+
+			UINT index;
+			if (freeList != none) {
+				index = freeList;
+				freeList = nodes[index].next;
+			}
+			else {
+				nodes.push_back({});
+				index = static_cast<UINT>(nodes.size() - 1);
+				nodes[index].generation = 1;
+			}
+
+			Node &node = nodes[index];
+			node.due = due;
+			node.period = period;
+			node.dueTick = static_cast<UINT64>((due + tickCount - 1) / tickCount);
+			node.func = func;
+			node.ctx = ctx;
+			node.active = true;
+			link(index);
+			++pending;
+			return (static_cast<UINT64>(node.generation) << 32) | index;
+		}
+
+		static bool cancel(UINT64 id) {
+			UINT index = static_cast<UINT>(id);
+			if (index == none || index >= nodes.size() || nodes[index].generation != static_cast<UINT>(id >> 32) || !nodes[index].active) return false;
+			unlink(index);
+			free(index);
+			return true;
+		}
+
+		static void cascade(UINT level, UINT slot) {
+			UINT index = heads[level][slot];
+			heads[level][slot] = none;
+			setBit(occupied[level], slot, false);
+			while (index != none) {
+				UINT next = nodes[index].next;
+				link(index);
+				index = next;
+			}
+		}
+
+		// A repeating timer is linked again before its callback runs, so the callback may cancel it. Periods
+		// missed during a stall are skipped, keeping the phase.
+		static void fire(UINT slot, INT64 now) {
+			UINT index;
+			while ((index = heads[0][slot]) != none) {
+				unlink(index);
+				Node &node = nodes[index];
+				JobFunc func = node.func;
+				void *ctx = node.ctx;
+				if (node.period > 0) {
+					node.due += node.period;
+					if (node.due <= now) node.due += ((now - node.due) / node.period + 1) * node.period;
+					node.dueTick = static_cast<UINT64>((node.due + tickCount - 1) / tickCount);
+					link(index);
+				}
+				else free(index);
+				func(ctx);
+			}
+		}
+
+		// Start of the first occupied slot ahead, at the lowest level that has one : the tick it fires at for
+		// level 0, the boundary it cascades at above. Every slot in between is empty, so advance jumps there.
+		static UINT64 nextTick() {
+			for (UINT level = 0; level < numLevels; ++level) {
+				int next = occupied[level].next(static_cast<UINT>((current >> (8 * level)) & 255) + 1);
+				if (next < 0) continue;
+				UINT64 block = current >> (8 * (level + 1)) << (8 * (level + 1));
+				return block | (static_cast<UINT64>(next) << (8 * level));
+			}
+			return std::numeric_limits<UINT64>::max();
+		}
+
+		static void advance(INT64 now) {
+			UINT64 target = static_cast<UINT64>(now / tickCount);
+			while (pending != 0) {
+				UINT64 tick = nextTick();
+				if (tick > target) break;
+
+				current = tick;
+				for (UINT level = numLevels - 1; level > 0; --level) {
+					if ((current & ((1ULL << (8 * level)) - 1)) == 0) cascade(level, static_cast<UINT>(current >> (8 * level)) & 255);
+				}
+				fire(static_cast<UINT>(current & 255), now);
+			}
+			if (target > current) current = target;
+		}
+
+		static INT64 nextDeadline() {
+			if (pending == 0) return std::numeric_limits<INT64>::max();
+			return static_cast<INT64>(nextTick() * tickCount);
+		}
+	};
+
+	std::vector<Timer_Impl::Node> Timer_Impl::nodes;
+	UINT Timer_Impl::freeList = Timer_Impl::none;
+	UINT Timer_Impl::heads[Timer_Impl::numLevels][256] = {};
+	KeyMask Timer_Impl::occupied[Timer_Impl::numLevels] = {};
+	UINT64 Timer_Impl::current = 0;
+	INT64 Timer_Impl::tickCount = 1;
+	UINT Timer_Impl::pending = 0;
+
+	struct EventLoop_Impl {
+		static std::atomic<bool> isRunning;
+		static double tpc;
+		static double tpl;
+		static double tpf;
+		static INT64 cps;
+		static INT64 currTime;
+		static INT64 prevLoop;
+		static INT64 prevFrame;
+		static MSG msg;
+		static UINT pacing;
+		static INT64 countPerFrame;
+		static INT64 spinCount;
+		static HANDLE timer;
+		static INT64 paceTime;
+		static UINT tickRate;
+		static UINT maxTicks;
+		static UINT ticks;
+		static INT64 tickTime;
+		static INT64 tickAccum;
+		static UINT64 droppedTicks;
+		static TimeRing_Impl frameTimes;
+		static TimeRing_Impl loopTimes;
+		static bool rawBatching;
+		static std::vector<UINT64> rawBuffer;
+		static UINT rawCount;
+		static void (*frameBarrier)();
+		static double pumpTime;
+		static UINT pumpMessages;
+		static PumpStats pumpStats;
+
+		// Drains every pending raw input report with GetRawInputBuffer. The buffer is UINT64 backed, so reports
+		// stay 8-byte aligned, and holds at least 64 reports so a burst needs only a few calls.
+		static void readRawInput() {
+			rawCount = 0;
+			for (;;) {
+				UINT size = 0;
+				if (GetRawInputBuffer(nullptr, &size, sizeof(RAWINPUTHEADER)) != 0 || size == 0) return;
+				size_t words = (static_cast<size_t>(size) * 64 + sizeof(UINT64) - 1) / sizeof(UINT64);
+				if (rawBuffer.size() < words) rawBuffer.resize(words);
+
+				UINT bufferSize = static_cast<UINT>(rawBuffer.size() * sizeof(UINT64));
+				RAWINPUT *rawInput = reinterpret_cast<RAWINPUT*>(rawBuffer.data());
+				UINT count = GetRawInputBuffer(rawInput, &bufferSize, sizeof(RAWINPUTHEADER));
+				if (count == 0 || count == static_cast<UINT>(-1)) return;
+
+				for (UINT i = 0; i < count; ++i) {
+					if (Recorder_Impl::mode == Recorder_Impl::Mode::Record) Recorder_Impl::writeRawInput(*rawInput);
+					MessageSink_Impl::notifyRawInput(*rawInput);
+					rawInput = NEXTRAWINPUTBLOCK(rawInput);
+				}
+				rawCount += count;
+			}
+		}
+
+		// A WM_INPUT that arrived after the bulk read still carries its report.
+		static void readRawInput(LPARAM lParam) {
+			RAWINPUT rawInput;
+			UINT size = sizeof(rawInput);
+			if (GetRawInputData(reinterpret_cast<HRAWINPUT>(lParam), RID_INPUT, &rawInput, &size, sizeof(RAWINPUTHEADER)) == static_cast<UINT>(-1)) return;
+			if (Recorder_Impl::mode == Recorder_Impl::Mode::Record) Recorder_Impl::writeRawInput(rawInput);
+			MessageSink_Impl::notifyRawInput(rawInput);
+			++rawCount;
+		}
+
+		// In batching mode the report is read here, but WM_INPUT is still dispatched so DefWindowProc can clean
+		// it up (GET_RAWINPUT_CODE_WPARAM == RIM_INPUT requires it).
+		static void handleMessage() {
+			if (rawBatching && msg.message == WM_INPUT) {
+				readRawInput(msg.lParam);
+				DispatchMessageW(&msg);
+				return;
+			}
+			if (Recorder_Impl::mode == Recorder_Impl::Mode::Record) {
+				if (msg.message != WM_INPUT) Recorder_Impl::writeMessage(msg);
+				else {
+					RAWINPUT rawInput;
+					UINT size = sizeof(rawInput);
+					if (GetRawInputData(reinterpret_cast<HRAWINPUT>(msg.lParam), RID_INPUT, &rawInput, &size, sizeof(RAWINPUTHEADER)) != static_cast<UINT>(-1)) {
+						Recorder_Impl::writeRawInput(rawInput);
+					}
+				}
+			}
+			if (MessageSink_Impl::first != nullptr) MessageSink_Impl::notify(msg);
+			TranslateMessage(&msg);
+			DispatchMessageW(&msg);
+		}
+
+		// Without a budget the queue is drained. With one, input and paint messages are retrieved first, then the
+		// rest, and the pump stops once the time or message budget is spent; what is left waits for the next loop.
+		static void pump(UINT wMsgFilterMin, UINT wMsgFilterMax, UINT wRemoveMsg) {
+			INT64 start;
+			QueryPerformanceCounter(reinterpret_cast<LARGE_INTEGER*>(&start));
+			UINT count = 0;
+			bool overrun = false;
+
+			if (pumpTime <= 0.0 && pumpMessages == 0) {
+				while (PeekMessageW(&msg, nullptr, wMsgFilterMin, wMsgFilterMax, wRemoveMsg)) {
+					handleMessage();
+					++count;
+				}
+			}
+			else {
+				INT64 deadline = pumpTime > 0.0 ? start + static_cast<INT64>(pumpTime * cps) : std::numeric_limits<INT64>::max();
+				UINT limit = pumpMessages != 0 ? pumpMessages : std::numeric_limits<UINT>::max();
+				const UINT passes[] = { wRemoveMsg | PM_QS_INPUT | PM_QS_PAINT, wRemoveMsg };
+				for (UINT pass : passes) {
+					while (!overrun && PeekMessageW(&msg, nullptr, wMsgFilterMin, wMsgFilterMax, pass)) {
+						handleMessage();
+						INT64 now;
+						QueryPerformanceCounter(reinterpret_cast<LARGE_INTEGER*>(&now));
+						overrun = ++count >= limit || now >= deadline;
+					}
+				}
+				MSG next;
+				if (overrun) overrun = PeekMessageW(&next, nullptr, wMsgFilterMin, wMsgFilterMax, PM_NOREMOVE) != FALSE;
+			}
+
+			INT64 end;
+			QueryPerformanceCounter(reinterpret_cast<LARGE_INTEGER*>(&end));
+			double time = (end - start) * tpc;
+			++pumpStats.loops;
+			if (overrun) ++pumpStats.overruns;
+			pumpStats.messages += count;
+			pumpStats.lastMessages = count;
+			pumpStats.lastTime = time;
+			if (time > pumpStats.maxTime) pumpStats.maxTime = time;
+		}
+
+		// Messages the UI thread retrieved and already dispatched; here only the recorder and the sinks see them.
+		static void readForwarded() {
+			UIThread_Impl::Event *event;
+			while ((event = UIThread_Impl::events.front()) != nullptr) {
+				if (event->isRaw) {
+					if (Recorder_Impl::mode == Recorder_Impl::Mode::Record) Recorder_Impl::writeRawInput(event->rawInput);
+					MessageSink_Impl::notifyRawInput(event->rawInput);
+				}
+				else {
+					msg = event->msg;
+					if (Recorder_Impl::mode == Recorder_Impl::Mode::Record) Recorder_Impl::writeMessage(msg);
+					if (MessageSink_Impl::first != nullptr) MessageSink_Impl::notify(msg);
+				}
+				UIThread_Impl::events.pop();
+			}
+		}
+
+		static void endLoop() {
+			tpl = (currTime - prevLoop) * tpc;
+			prevLoop = currTime;
+			loopTimes.push(tpl);
+			Timer_Impl::advance(currTime);
+			Coroutine_Impl::resumeLoop(currTime);
+		}
+
+		// Time of the last loop, or the current count before the first one.
+		static INT64 loopTime() {
+			if (prevLoop != 0) return prevLoop;
+			INT64 now;
+			QueryPerformanceCounter(reinterpret_cast<LARGE_INTEGER*>(&now));
+			return now;
+		}
+
+		// Counts per second of the loop clock: the replayed log's while replaying, the live frequency before init.
+		static INT64 countPerSecond() {
+			if (cps != 0) return cps;
+			INT64 res;
+			QueryPerformanceFrequency(reinterpret_cast<LARGE_INTEGER*>(&res));
+			return res;
+		}
+
+		// The frame deadline, or the due count of an earlier timer or delay, so those fire on time while pacing.
+		static INT64 nextDeadline(INT64 deadline) {
+			INT64 timerDue = Timer_Impl::nextDeadline();
+			if (timerDue < deadline) deadline = timerDue;
+			if (!Coroutine_Impl::timed.empty() && Coroutine_Impl::timed.front().due < deadline) deadline = Coroutine_Impl::timed.front().due;
+			return deadline;
+		}
+
+		// Live messages are dropped while replaying, except the local ones the log leaves out. Recorded
+		// messages up to the next loop record are then dispatched, and the loop takes the recorded time.
+		static bool replayLoop(UINT wMsgFilterMin, UINT wMsgFilterMax, UINT wRemoveMsg) {
+			if (UIThread_Impl::isRunning()) UIThread_Impl::discard();
+			while (PeekMessageW(&msg, nullptr, wMsgFilterMin, wMsgFilterMax, wRemoveMsg)) {
+				if (!Recorder_Impl::isLocal(msg)) continue;
+				TranslateMessage(&msg);
+				DispatchMessageW(&msg);
+			}
+
+			Recorder_Impl::Record record;
+			while (Recorder_Impl::read(record)) {
+				switch (record.type) {
+				case Recorder_Impl::Message:
+					msg = Recorder_Impl::toMsg(record);
+					if (MessageSink_Impl::first != nullptr) MessageSink_Impl::notify(msg);
+					UIThread_Impl::dispatch(msg);
+					break;
+				case Recorder_Impl::RawInput:
+					MessageSink_Impl::notifyRawInput(Recorder_Impl::rawInput);
+					break;
+				case Recorder_Impl::Loop:
+					if (Coalescer_Impl::first != nullptr) Coalescer_Impl::flushAll();
+					currTime = record.time;
+					endLoop();
+					return isRunning;
+				default:
+					break;
+				}
+			}
+
+			Recorder::stop();
+			isRunning = false;
+			return false;
+		}
+
+		// Sleep on a waitable timer until shortly before the next frame deadline, waking early on input,
+		// including input the UI thread forwarded, then spin the remaining spinCount. spinCount tracks the
+		// timer's observed oversleep. Deadlines follow the loop's own wakes, one countPerFrame apart,
+		// independent of what fps() is called with.
+		static void waitNextFrame() {
+			INT64 now;
+			QueryPerformanceCounter(reinterpret_cast<LARGE_INTEGER*>(&now));
+			if (paceTime == 0) paceTime = now;
+			INT64 frameDeadline = paceTime + countPerFrame;
+			INT64 deadline = nextDeadline(frameDeadline);
+			INT64 sleepUntil = deadline - spinCount;
+
+			if (now < sleepUntil) {
+				LARGE_INTEGER dueTime;
+				dueTime.QuadPart = -((sleepUntil - now) * 10000000 / cps);
+				if (dueTime.QuadPart < 0 && SetWaitableTimer(timer, &dueTime, 0, nullptr, nullptr, FALSE)) {
+					HANDLE handles[2] = { timer, UIThread_Impl::appWake };
+					DWORD count = 1;
+					DWORD wakeMask = QS_ALLINPUT;
+					if (UIThread_Impl::isRunning()) {
+						// Reset before looking at the ring, so a push after the check still signals the wait.
+						ResetEvent(UIThread_Impl::appWake);
+						if (UIThread_Impl::events.front() != nullptr) return;
+						count = 2;
+						wakeMask = 0;
+					}
+					if (MsgWaitForMultipleObjectsEx(count, handles, INFINITE, wakeMask, MWMO_INPUTAVAILABLE) != WAIT_OBJECT_0) return;
+
+					QueryPerformanceCounter(reinterpret_cast<LARGE_INTEGER*>(&now));
+					INT64 overSleep = now - sleepUntil;
+					if (overSleep > spinCount) spinCount = overSleep;
+					else spinCount -= (spinCount - overSleep) / 16;
+					if (spinCount < cps / 10000) spinCount = cps / 10000;
+					if (spinCount > countPerFrame) spinCount = countPerFrame;
+				}
+			}
+
+			while (now < deadline) {
+				YieldProcessor();
+				QueryPerformanceCounter(reinterpret_cast<LARGE_INTEGER*>(&now));
+			}
+
+			// A loop that fell a whole frame behind starts over from now instead of catching up.
+			if (now >= frameDeadline) paceTime = now - frameDeadline >= countPerFrame ? now : frameDeadline;
+		}
+
+		static void closeTimer() {
+			if (timer != nullptr) CloseHandle(timer);
+			timer = nullptr;
+		}
+	};
+
+	std::atomic<bool> EventLoop_Impl::isRunning(false);
+	double EventLoop_Impl::tpc = 0.0;
+	double EventLoop_Impl::tpl = 0.0;
+	double EventLoop_Impl::tpf = 0.0;
+	INT64 EventLoop_Impl::cps = 0;
+	INT64 EventLoop_Impl::currTime = 0;
+	INT64 EventLoop_Impl::prevLoop = 0;
+	INT64 EventLoop_Impl::prevFrame = 0;
+	MSG EventLoop_Impl::msg = {};
+	UINT EventLoop_Impl::pacing = 0;
+	INT64 EventLoop_Impl::countPerFrame = 0;
+	INT64 EventLoop_Impl::spinCount = 0;
+	HANDLE EventLoop_Impl::timer = nullptr;
+	INT64 EventLoop_Impl::paceTime = 0;
+	UINT EventLoop_Impl::tickRate = 0;
+	UINT EventLoop_Impl::maxTicks = 8;
+	UINT EventLoop_Impl::ticks = 0;
+	INT64 EventLoop_Impl::tickTime = 0;
+	INT64 EventLoop_Impl::tickAccum = 0;
+	UINT64 EventLoop_Impl::droppedTicks = 0;
+	TimeRing_Impl EventLoop_Impl::frameTimes = {};
+	TimeRing_Impl EventLoop_Impl::loopTimes = {};
+	bool EventLoop_Impl::rawBatching = false;
+	std::vector<UINT64> EventLoop_Impl::rawBuffer;
+	UINT EventLoop_Impl::rawCount = 0;
+	void (*EventLoop_Impl::frameBarrier)() = nullptr;
+	double EventLoop_Impl::pumpTime = 0.0;
+	UINT EventLoop_Impl::pumpMessages = 0;
+	PumpStats EventLoop_Impl::pumpStats = {};
+
+	// While replaying, the clock keeps the log's frequency and starts at the recorded init time.
+	void EventLoop::init() {
+		EventLoop_Impl::isRunning = true;
+		if (Recorder_Impl::mode == Recorder_Impl::Mode::Replay) {
+			Recorder_Impl::Record record;
+			if (Recorder_Impl::peek(record) && record.type == Recorder_Impl::Init) {
+				Recorder_Impl::read(record);
+				EventLoop_Impl::currTime = record.time;
+			}
+			EventLoop_Impl::prevLoop = EventLoop_Impl::currTime;
+		}
+		else {
+			QueryPerformanceFrequency(reinterpret_cast<LARGE_INTEGER*>(&EventLoop_Impl::cps));
+			EventLoop_Impl::tpc = 1.0 / EventLoop_Impl::cps;
+			QueryPerformanceCounter(reinterpret_cast<LARGE_INTEGER*>(&EventLoop_Impl::prevLoop));
+			if (Recorder_Impl::mode == Recorder_Impl::Mode::Record) Recorder_Impl::writeInit(EventLoop_Impl::prevLoop);
+		}
+		EventLoop_Impl::prevFrame = EventLoop_Impl::prevLoop;
+		EventLoop_Impl::paceTime = EventLoop_Impl::prevLoop;
+		EventLoop_Impl::spinCount = EventLoop_Impl::cps / 1000;
+		EventLoop_Impl::tickTime = EventLoop_Impl::prevLoop;
+		EventLoop_Impl::tickAccum = 0;
+		EventLoop_Impl::ticks = 0;
+		if (EventLoop_Impl::pacing != 0) setPacing(EventLoop_Impl::pacing);
+	}
+
+	// Before init the frequency is queried here, so pacing is ready once the loop starts.
+	void EventLoop::setPacing(UINT fps) {
+		EventLoop_Impl::pacing = fps;
+		if (fps == 0) {
+			EventLoop_Impl::closeTimer();
+			return;
+		}
+
+		INT64 cps = EventLoop_Impl::countPerSecond();
+		EventLoop_Impl::countPerFrame = (cps + fps - 1) / fps;
+		if (EventLoop_Impl::timer == nullptr) {
+			EventLoop_Impl::timer = CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+			if (EventLoop_Impl::timer == nullptr) EventLoop_Impl::timer = CreateWaitableTimerExW(nullptr, nullptr, 0, TIMER_ALL_ACCESS);
+		}
+		if (EventLoop_Impl::timer == nullptr) EventLoop_Impl::pacing = 0;
+	}
+
+	UINT EventLoop::getPacing() {
+		return EventLoop_Impl::pacing;
+	}
+
+	INT64 EventLoop::getCountPerSecond() {
+		INT64 cps;
+		QueryPerformanceFrequency(reinterpret_cast<LARGE_INTEGER*>(&cps));
+		return cps;
+	}
+
+	INT64 EventLoop::getCurrentCount() {
+		INT64 curr;
+		QueryPerformanceCounter(reinterpret_cast<LARGE_INTEGER*>(&curr));
+		return curr;
+	}
+
+	INT64 EventLoop::getCountLastLoop() {
+		return EventLoop_Impl::prevLoop;
+	}
+
+	INT64 EventLoop::getCountLastFrame() {
+		return EventLoop_Impl::prevFrame;
+	}
+
+	bool EventLoop::fps(UINT fps) {
+		EventLoop_Impl::tpf = (EventLoop_Impl::currTime - EventLoop_Impl::prevFrame) * EventLoop_Impl::tpc;
+		bool res = 1.0 / EventLoop_Impl::tpf <= fps;
+
+		if (Recorder_Impl::mode == Recorder_Impl::Mode::Replay) {
+			Recorder_Impl::Record record;
+			if (Recorder_Impl::peek(record) && record.type == Recorder_Impl::Fps) {
+				Recorder_Impl::read(record);
+				res = record.wParam != 0;
+			}
+		}
+		else if (Recorder_Impl::mode == Recorder_Impl::Mode::Record) Recorder_Impl::writeFps(fps, res);
+
+		if (res) {
+			if (EventLoop_Impl::frameBarrier != nullptr) EventLoop_Impl::frameBarrier();
+			EventLoop_Impl::prevFrame = EventLoop_Impl::currTime;
+			EventLoop_Impl::frameTimes.push(EventLoop_Impl::tpf);
+			Coroutine_Impl::resumeFrame();
+		}
+		return res;
+	}
+
+	// The accumulator counts elapsed counts scaled by the tick rate, so one tick is exactly cps units
+	// and no fractional time is lost between loops.
+	bool EventLoop::tick(UINT rate) {
+		if (rate == 0 || EventLoop_Impl::cps == 0) return false;
+
+		if (rate != EventLoop_Impl::tickRate) {
+			if (EventLoop_Impl::tickRate != 0) EventLoop_Impl::tickAccum = EventLoop_Impl::tickAccum * rate / EventLoop_Impl::tickRate;
+			EventLoop_Impl::tickRate = rate;
+		}
+
+		if (EventLoop_Impl::tickTime != EventLoop_Impl::currTime) {
+			EventLoop_Impl::tickAccum += (EventLoop_Impl::currTime - EventLoop_Impl::tickTime) * rate;
+			EventLoop_Impl::tickTime = EventLoop_Impl::currTime;
+			EventLoop_Impl::ticks = 0;
+		}
+
+		if (EventLoop_Impl::tickAccum < EventLoop_Impl::cps) return false;
+
+		if (EventLoop_Impl::ticks >= EventLoop_Impl::maxTicks) {
+			EventLoop_Impl::droppedTicks += EventLoop_Impl::tickAccum / EventLoop_Impl::cps;
+			EventLoop_Impl::tickAccum %= EventLoop_Impl::cps;
+			return false;
+		}
+
+		EventLoop_Impl::tickAccum -= EventLoop_Impl::cps;
+		++EventLoop_Impl::ticks;
+		return true;
+	}
+
+	void EventLoop::setMaxTicks(UINT maxTicks) {
+		EventLoop_Impl::maxTicks = maxTicks == 0 ? 1 : maxTicks;
+	}
+
+	double EventLoop::getTickAlpha() {
+		if (EventLoop_Impl::cps == 0) return 0.0;
+		return static_cast<double>(EventLoop_Impl::tickAccum) / EventLoop_Impl::cps;
+	}
+
+	UINT64 EventLoop::getDroppedTicks() {
+		return EventLoop_Impl::droppedTicks;
+	}
+
+	bool EventLoop::isActive(HWND hWnd, UINT wMsgFilterMin, UINT wMsgFilterMax, UINT wRemoveMsg) {
+		if (Recorder_Impl::mode == Recorder_Impl::Mode::Replay) return EventLoop_Impl::replayLoop(wMsgFilterMin, wMsgFilterMax, wRemoveMsg);
+		if (EventLoop_Impl::pacing != 0 && EventLoop_Impl::isRunning) EventLoop_Impl::waitNextFrame();
+
+		// With the UI thread running, the calling thread's own queue still holds thread messages and the
+		// messages of windows created before UIThread::start, so it is pumped as well.
+		if (UIThread_Impl::isRunning()) EventLoop_Impl::readForwarded();
+		if (EventLoop_Impl::rawBatching) EventLoop_Impl::readRawInput();
+
+		EventLoop_Impl::pump(wMsgFilterMin, wMsgFilterMax, wRemoveMsg);
+		if (Coalescer_Impl::first != nullptr) Coalescer_Impl::flushAll();
+
+		QueryPerformanceCounter(reinterpret_cast<LARGE_INTEGER*>(&EventLoop_Impl::currTime));
+		if (Recorder_Impl::mode == Recorder_Impl::Mode::Record) Recorder_Impl::writeLoop(EventLoop_Impl::currTime);
+		EventLoop_Impl::endLoop();
+		if (!EventLoop_Impl::isRunning) EventLoop_Impl::closeTimer();
+		return EventLoop_Impl::isRunning;
+	}
+
+	void EventLoop::destroy() {
+		EventLoop_Impl::isRunning = false;
+	}
+
+	MSG EventLoop::getMSG() {
+		return EventLoop_Impl::msg;
+	}
+
+	double EventLoop::getTimePerFrame() {
+		return EventLoop_Impl::tpf;
+	}
+
+	double EventLoop::getTimePerLoop() {
+		return EventLoop_Impl::tpl;
+	}
+
+	TimeStats EventLoop::getFrameStats() {
+		return EventLoop_Impl::frameTimes.stats();
+	}
+
+	TimeStats EventLoop::getLoopStats() {
+		return EventLoop_Impl::loopTimes.stats();
+	}
+
+	UINT EventLoop::getFrameHistogram(UINT *buckets, UINT numBuckets) {
+		return EventLoop_Impl::frameTimes.histogram(buckets, numBuckets);
+	}
+
+	UINT EventLoop::getLoopHistogram(UINT *buckets, UINT numBuckets) {
+		return EventLoop_Impl::loopTimes.histogram(buckets, numBuckets);
+	}
+
+	double EventLoop::getHistogramBucketTime(UINT bucket) {
+		if (bucket == 0) return 0.0;
+		return std::exp2((bucket - 1) / 4.0) / 1000000.0;
+	}
+
+	void EventLoop::resetStats() {
+		EventLoop_Impl::frameTimes.reset();
+		EventLoop_Impl::loopTimes.reset();
+		Coalescer_Impl::merged.store(0, std::memory_order_relaxed);
+		EventLoop_Impl::pumpStats = {};
+	}
+
+	void EventLoop::setPumpBudget(double seconds, UINT messages) {
+		EventLoop_Impl::pumpTime = seconds;
+		EventLoop_Impl::pumpMessages = messages;
+	}
+
+	PumpStats EventLoop::getPumpStats() {
+		return EventLoop_Impl::pumpStats;
+	}
+
+	void EventLoop::setCoalescing(bool enable) {
+		Coalescer_Impl::enabled.store(enable, std::memory_order_relaxed);
+	}
+
+	bool EventLoop::getCoalescing() {
+		return Coalescer_Impl::enabled.load(std::memory_order_relaxed);
+	}
+
+	UINT64 EventLoop::getCoalescedCount() {
+		return Coalescer_Impl::merged.load(std::memory_order_relaxed);
+	}
+
+	UINT EventLoop::getMergeCount() {
+		return Coalescer_Impl::current;
+	}
+
+	void EventLoop::setRawInputBatching(bool enable) {
+		EventLoop_Impl::rawBatching = enable;
+	}
+
+	bool EventLoop::getRawInputBatching() {
+		return EventLoop_Impl::rawBatching;
+	}
+
+	UINT EventLoop::getRawInputCount() {
+		return EventLoop_Impl::rawCount;
+	}
+
+	bool Recorder::record(const char *path) {
+		stop();
+		Recorder_Impl::file = Recorder_Impl::open(path, "wb");
+		if (Recorder_Impl::file == nullptr) return false;
+
+		Recorder_Impl::Header header{ { 'W', 'F', 'L', 'G' }, Recorder_Impl::version, EventLoop_Impl::cps, EventLoop_Impl::prevLoop,
+			EventLoop_Impl::prevFrame, EventLoop_Impl::tickTime, EventLoop_Impl::tickAccum };
+		if (header.cps == 0) {
+			QueryPerformanceFrequency(reinterpret_cast<LARGE_INTEGER*>(&header.cps));
+			header.prevLoop = Recorder_Impl::now();
+			header.prevFrame = header.prevLoop;
+			header.tickTime = header.prevLoop;
+		}
+		if (std::fwrite(&header, sizeof(header), 1, Recorder_Impl::file) != 1) {
+			Recorder_Impl::close();
+			return false;
+		}
+		Recorder_Impl::beginSession();
+		Recorder_Impl::mode = Recorder_Impl::Mode::Record;
+		Recorder_Impl::count = 0;
+		return true;
+	}
+
+	// The loop clock is taken over from the log, so fps(), tick() and the frame statistics see the recorded times.
+	bool Recorder::replay(const char *path) {
+		stop();
+		Recorder_Impl::file = Recorder_Impl::open(path, "rb");
+		if (Recorder_Impl::file == nullptr) return false;
+
+		Recorder_Impl::Header header;
+		if (std::fread(&header, sizeof(header), 1, Recorder_Impl::file) != 1 || std::memcmp(header.magic, "WFLG", 4) != 0 ||
+			header.version != Recorder_Impl::version || header.cps <= 0) {
+			Recorder_Impl::close();
+			return false;
+		}
+		EventLoop_Impl::cps = header.cps;
+		EventLoop_Impl::tpc = 1.0 / header.cps;
+		EventLoop_Impl::prevLoop = header.prevLoop;
+		EventLoop_Impl::prevFrame = header.prevFrame;
+		EventLoop_Impl::currTime = header.prevLoop;
+		EventLoop_Impl::tickTime = header.tickTime;
+		EventLoop_Impl::tickAccum = header.tickAccum;
+		Recorder_Impl::beginSession();
+		Recorder_Impl::mode = Recorder_Impl::Mode::Replay;
+		Recorder_Impl::count = 0;
+		return true;
+	}
+
+	void Recorder::stop() {
+		bool replaying = Recorder_Impl::mode == Recorder_Impl::Mode::Replay;
+		Recorder_Impl::close();
+		if (!replaying) return;
+
+		QueryPerformanceFrequency(reinterpret_cast<LARGE_INTEGER*>(&EventLoop_Impl::cps));
+		EventLoop_Impl::tpc = 1.0 / EventLoop_Impl::cps;
+		QueryPerformanceCounter(reinterpret_cast<LARGE_INTEGER*>(&EventLoop_Impl::currTime));
+		EventLoop_Impl::prevLoop = EventLoop_Impl::currTime;
+		EventLoop_Impl::prevFrame = EventLoop_Impl::currTime;
+		EventLoop_Impl::paceTime = EventLoop_Impl::currTime;
+		EventLoop_Impl::tickTime = EventLoop_Impl::currTime;
+		if (EventLoop_Impl::pacing != 0) EventLoop::setPacing(EventLoop_Impl::pacing);
+	}
+
+	bool Recorder::isRecording() {
+		return Recorder_Impl::mode == Recorder_Impl::Mode::Record;
+	}
+
+	bool Recorder::isReplaying() {
+		return Recorder_Impl::mode == Recorder_Impl::Mode::Replay;
+	}
+
+	UINT64 Recorder::getRecordCount() {
+		return Recorder_Impl::count;
+	}
+
+	bool UIThread::start(UINT capacity) {
+		if (UIThread_Impl::isRunning()) return false;
+
+		try {
+			UIThread_Impl::events.init(capacity);
+			UIThread_Impl::commands.init(256);
+		}
+		catch (...) {
+			return false;
+		}
+
+		UIThread_Impl::wake = CreateEventW(nullptr, FALSE, FALSE, nullptr);
+		if (UIThread_Impl::wake == nullptr) return false;
+		UIThread_Impl::appWake = CreateEventW(nullptr, FALSE, FALSE, nullptr);
+		if (UIThread_Impl::appWake == nullptr) {
+			CloseHandle(UIThread_Impl::wake);
+			UIThread_Impl::wake = nullptr;
+			return false;
+		}
+
+		UIThread_Impl::running.store(true, std::memory_order_release);
+		try {
+			UIThread_Impl::thread = new std::thread(&UIThread_Impl::run);
+		}
+		catch (...) {
+			UIThread_Impl::running.store(false, std::memory_order_release);
+			CloseHandle(UIThread_Impl::wake);
+			UIThread_Impl::wake = nullptr;
+			CloseHandle(UIThread_Impl::appWake);
+			UIThread_Impl::appWake = nullptr;
+			return false;
+		}
+		return true;
+	}
+
+	void UIThread::stop() {
+		if (!UIThread_Impl::isRemote()) return;
+
+		UIThread_Impl::command(UIThread_Impl::CommandType::Quit, nullptr);
+		UIThread_Impl::submit();
+		UIThread_Impl::thread->join();
+		delete UIThread_Impl::thread;
+		UIThread_Impl::thread = nullptr;
+
+		UIThread_Impl::running.store(false, std::memory_order_release);
+		UIThread_Impl::discard();
+		CloseHandle(UIThread_Impl::wake);
+		UIThread_Impl::wake = nullptr;
+		CloseHandle(UIThread_Impl::appWake);
+		UIThread_Impl::appWake = nullptr;
+	}
+
+	bool UIThread::isRunning() {
+		return UIThread_Impl::isRunning();
+	}
+
+	bool UIThread::isCurrent() {
+		return UIThread_Impl::current;
+	}
+
+	void UIThread::invoke(void (*func)(void*), void *ctx) {
+		UIThread_Impl::call(func, ctx);
+	}
+
+	UINT64 UIThread::getDroppedMessages() {
+		return UIThread_Impl::dropped.load(std::memory_order_relaxed);
+	}
+
+	bool Coroutine::onNextFrame(JobFunc func, void *ctx) {
+		try {
+			Coroutine_Impl::frameWaiters.push_back({ func, ctx });
+		}
+		catch (...) {
+			return false;
+		}
+		++Coroutine_Impl::suspended;
+		return true;
+	}
+
+	// Due counts are taken from the current loop time, so delays also line up while replaying. Every delay
+	// waits for at least the next loop.
+	bool Coroutine::onDelay(double seconds, JobFunc func, void *ctx) {
+		INT64 now = EventLoop_Impl::loopTime();
+		INT64 due = now + static_cast<INT64>(seconds * EventLoop_Impl::countPerSecond());
+		if (due <= now) due = now + 1;
+		try {
+			Coroutine_Impl::addTimed(due, func, ctx);
+		}
+		catch (...) {
+			return false;
+		}
+		return true;
+	}
+
+	bool Coroutine::onKeyPressed(BYTE vKey, JobFunc func, void *ctx) {
+		try {
+			Coroutine_Impl::addKey(vKey, func, ctx);
+		}
+		catch (...) {
+			return false;
+		}
+		return true;
+	}
+
+	UINT64 Timer::schedule(double seconds, JobFunc func, void *ctx, double period) {
+		INT64 cps = EventLoop_Impl::countPerSecond();
+		INT64 now = EventLoop_Impl::loopTime();
+		try {
+			return Timer_Impl::add(cps, now, now + static_cast<INT64>(seconds * cps), static_cast<INT64>(period * cps), func, ctx);
+		}
+		catch (...) {
+			return 0;
+		}
+	}
+
+	bool Timer::cancel(UINT64 id) {
+		return Timer_Impl::cancel(id);
+	}
+
+	UINT Timer::getPendingCount() {
+		return Timer_Impl::pending;
+	}
+
+	INT64 Timer::getNextDeadline() {
+		INT64 deadline = Timer_Impl::nextDeadline();
+		return deadline == std::numeric_limits<INT64>::max() ? 0 : deadline;
+	}
+
+	UINT Coroutine::getSuspendedCount() {
+		return Coroutine_Impl::suspended;
+	}
+
+	void* Coroutine::allocate(size_t size) {
+		return CoroutineArena_Impl::allocate(size);
+	}
+
+	void Coroutine::release(void *ptr, size_t size) {
+		CoroutineArena_Impl::release(ptr, size);
+	}
+}
+
+// Mouse
+namespace WinFW {
+	void Mouse::useRawInputMouse(Window *window) {
+		HWND hWnd = window == nullptr ? nullptr : window->get();
+		RAWINPUTDEVICE rid{ 0x01, 0x02, 0, hWnd };
+		RegisterRawInputDevices(&rid, 1, sizeof(RAWINPUTDEVICE));
+	}
+
+	void Mouse::disableRawInputMouse() {
+		RAWINPUTDEVICE rid{ 0x01, 0x02, RIDEV_REMOVE, nullptr };
+		RegisterRawInputDevices(&rid, 1, sizeof(RAWINPUTDEVICE));
+	}
+}
+
+// Pool
+namespace WinFW {
+	// Size-classed free lists kept per thread. A miss falls back to ::operator new, and a release beyond
+	// maxCached blocks of a class goes back to ::operator delete, so a thread never hoards memory.
+	struct Pool_Impl {
+		static constexpr size_t granularity = 16;
+		static constexpr size_t numClasses = 16;
+		static constexpr UINT maxCached = 256;
+
+		struct Block {
+			Block *next;
+		};
+
+		struct Cache {
+			Block *heads[numClasses];
+			UINT counts[numClasses];
+			std::atomic<UINT64> hits;
+			std::atomic<UINT64> misses;
+			Cache *next;
+
+			Cache() : heads{}, counts{}, hits(0), misses(0), next(nullptr) {
+				std::lock_guard<std::mutex> lock(mutex);
+				next = caches;
+				caches = this;
+				state = 1;
+			}
+
+			~Cache() {
+				state = 2;
+				for (size_t i = 0; i < numClasses; ++i) {
+					while (heads[i] != nullptr) {
+						Block *block = heads[i];
+						heads[i] = block->next;
+						::operator delete(block);
+					}
+				}
+
+				std::lock_guard<std::mutex> lock(mutex);
+				exitedHits += hits.load(std::memory_order_relaxed);
+				exitedMisses += misses.load(std::memory_order_relaxed);
+				for (Cache **it = &caches; *it != nullptr; it = &(*it)->next) {
+					if (*it == this) {
+						*it = next;
+						break;
+					}
+				}
+			}
+
+			// Only the owning thread writes its counters, so a relaxed load / store pair is enough.
+			static void count(std::atomic<UINT64> &counter) {
+				counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+			}
+		};
+
+		static thread_local Cache cache;
+		static thread_local int state;
+		static std::mutex mutex;
+		static Cache *caches;
+		static UINT64 exitedHits;
+		static UINT64 exitedMisses;
+
+		static void* allocate(size_t size) {
+			size_t index = (size - 1) / granularity;
+			if (index >= numClasses || state == 2) return ::operator new(size);
+
+			Cache &local = cache;
+			Block *block = local.heads[index];
+			if (block != nullptr) {
+				local.heads[index] = block->next;
+				--local.counts[index];
+				Cache::count(local.hits);
+				return block;
+			}
+			Cache::count(local.misses);
+			return ::operator new((index + 1) * granularity);
+		}
+
+		static void release(void *ptr, size_t size) {
+			if (ptr == nullptr) return;
+			size_t index = (size - 1) / granularity;
+			if (index >= numClasses || state == 2) {
+				::operator delete(ptr);
+				return;
+			}
+
+			Cache &local = cache;
+			if (local.counts[index] >= maxCached) {
+				::operator delete(ptr);
+				return;
+			}
+			Block *block = static_cast<Block*>(ptr);
+			block->next = local.heads[index];
+			local.heads[index] = block;
+			++local.counts[index];
+		}
+	};
+
+	thread_local Pool_Impl::Cache Pool_Impl::cache;
+	thread_local int Pool_Impl::state = 0;
+	std::mutex Pool_Impl::mutex;
+	Pool_Impl::Cache *Pool_Impl::caches = nullptr;
+	UINT64 Pool_Impl::exitedHits = 0;
+	UINT64 Pool_Impl::exitedMisses = 0;
+
+	PoolStats Pool::getStats() {
+		std::lock_guard<std::mutex> lock(Pool_Impl::mutex);
+		PoolStats stats{ Pool_Impl::exitedHits, Pool_Impl::exitedMisses };
+		for (Pool_Impl::Cache *it = Pool_Impl::caches; it != nullptr; it = it->next) {
+			stats.hits += it->hits.load(std::memory_order_relaxed);
+			stats.misses += it->misses.load(std::memory_order_relaxed);
+		}
+		return stats;
+	}
+}
+
+// Interface
+namespace WinFW {
+	void init(HINSTANCE hInstance) {
+		g_hInstance = hInstance;
+	}
+	
+	// Flat per-class table of the interfaces an implementation exposes, matched by RefID.
+	template<typename Impl, typename... Interfaces>
+	struct RefTable_Impl {
+		struct Entry {
+			unsigned long long id;
+			void* (*cast)(Impl*);
+		};
+
+		template<typename Interface>
+		static void* cast(Impl *impl) {
+			return static_cast<Interface*>(impl);
+		}
+
+		static bool query(Impl *impl, void **const ppRef, unsigned long long id) {
+			static const Entry entries[] = { { Interfaces::RefID, &cast<Interfaces> }... };
+			for (const Entry &entry : entries) {
+				if (entry.id == id) {
+					if (ppRef != nullptr) {
+						impl->incRef();
+						*ppRef = entry.cast(impl);
+					}
+					return true;
+				}
+			}
+			return false;
+		}
+	};
+
+	class Ref_Impl : public virtual Ref {
+		unsigned long long m_refCount;
+		RefPolicy m_policy;
+		DWORD m_owner;
+	protected:
+		virtual void destroy() {
+			delete this;
+		}
+	public:
+		virtual ~Ref_Impl() = default;
+
+		Ref_Impl() : Ref_Impl(1ULL) {
+		}
+
+		Ref_Impl(unsigned long long refCount) : Ref_Impl(refCount, RefPolicy::Atomic) {
+		}
+
+		Ref_Impl(unsigned long long refCount, RefPolicy policy) : m_refCount(refCount),
+			m_policy(policy), m_owner(GetCurrentThreadId()) {
+		}
+
+		unsigned long long numRef() {
+			return m_refCount;
+		}
+
+		unsigned long long incRef() {
+			if (m_policy == RefPolicy::Confined) {
+				assert(m_owner == GetCurrentThreadId() && "Confined Ref used from another thread");
+				return ++m_refCount;
+			}
+			return InterlockedIncrement(&m_refCount);
+		}
+
+		unsigned long long decRef() {
+			unsigned long long res;
+			if (m_policy == RefPolicy::Confined) {
+				assert(m_owner == GetCurrentThreadId() && "Confined Ref used from another thread");
+				res = --m_refCount;
+			}
+			else res = InterlockedDecrement(&m_refCount);
+			if (res == 0) destroy();
+			return res;
+		}
+
+		RefPolicy getRefPolicy() {
+			return m_policy;
+		}
+
+		static void* operator new(size_t size) {
+			return Pool_Impl::allocate(size);
+		}
+
+		static void operator delete(void *ptr, size_t size) {
+			Pool_Impl::release(ptr, size);
+		}
+
+		bool delRef() {
+			destroy();
+			return true;
+		}
+
+		bool queryRef(void **const ppRef, const char *id, bool) {
+			return queryRefById(ppRef, Hidden::RefHash(id));
+		}
+
+		bool queryRefById(void **const ppRef, unsigned long long id) {
+			return RefTable_Impl<Ref_Impl, Ref>::query(this, ppRef, id);
+		}
+
+		const char* getRefName() {
+			return Ref::GetRefName();
+		}
+	};
+
+	class Copyable_Impl : public virtual Copyable, public virtual Ref_Impl {
+	public:
+		Copyable_Impl() : Copyable_Impl(1ULL) {
+		}
+
+		Copyable_Impl(unsigned long long refCount) : Ref_Impl(refCount) {
+		}
+
+		const char* getRefName() {
+			return Copyable::GetRefName();
+		}
+
+		bool queryRefById(void **const ppRef, unsigned long long id) {
+			return RefTable_Impl<Copyable_Impl, Copyable, Ref>::query(this, ppRef, id);
+		}
+
+		bool copy(void **const ppRef, const char *id, bool) {
+			return copyById(ppRef, Hidden::RefHash(id));
+		}
+
+		bool copyById(void **const ppRef, unsigned long long id) {
+			return queryRefById(ppRef, id);
+		}
+	};
+
+	namespace Text {
+		class StringHolder_Impl final : public virtual StringHolder, public virtual Copyable_Impl {
+			char *m_str;
+			size_t m_count;
+			StringHolder::Deleter m_deleter;
+			bool m_external;
+
+			struct Payload {
+				size_t size;
+			};
+
+			static size_t payloadSize(const char *str, size_t count) {
+				return str == nullptr ? 0 : (count + 1) * sizeof(char);
+			}
+
+			static void* operator new(size_t size, Payload payload) {
+				return Pool_Impl::allocate(size + payload.size);
+			}
+
+			static void operator delete(void *ptr, Payload payload) {
+				Pool_Impl::release(ptr, sizeof(StringHolder_Impl) + payload.size);
+			}
+
+			using Ref_Impl::operator delete;
+
+			StringHolder_Impl(const char *str, size_t count) : m_str(nullptr), m_count(0), m_deleter(nullptr), m_external(false) {
+				if (str != nullptr) {
+					m_str = reinterpret_cast<char*>(reinterpret_cast<char*>(this) + sizeof(StringHolder_Impl));
+					m_count = count;
+					std::memcpy(m_str, str, count * sizeof(char));
+					m_str[count] = 0;
+				}
+			}
+
+			StringHolder_Impl(char *str, size_t count, StringHolder::Deleter deleter) : m_str(str), m_count(str == nullptr ? 0 : count),
+				m_deleter(deleter), m_external(true) {
+				assert((str == nullptr || str[count] == 0) && "StringHolder : external string must be null-terminated");
+			}
+
+			bool copyInterface(void **const ppRef) {
+				if (ppRef != nullptr) {
+					try {
+						if (m_external && m_deleter == nullptr) *ppRef = static_cast<StringHolder*>(CreateExternal(m_str, m_count, nullptr));
+						else *ppRef = static_cast<StringHolder*>(Create(m_str, m_count));
+					}
+					catch (...) {
+						return false;
+					}
+				}
+				return true;
+			}
+		protected:
+			void destroy() {
+				size_t size = sizeof(StringHolder_Impl) + (m_external ? 0 : payloadSize(m_str, m_count));
+				this->~StringHolder_Impl();
+				Pool_Impl::release(this, size);
+			}
+		public:
+			~StringHolder_Impl() {
+				if (m_deleter != nullptr) m_deleter(m_str);
+			}
+
+			static StringHolder_Impl* CreateExternal(char *str, size_t count, StringHolder::Deleter deleter) {
+				try {
+					return new (Payload{ 0 }) StringHolder_Impl(str, count, deleter);
+				}
+				catch (...) {
+					if (deleter != nullptr) deleter(str);
+					throw;
+				}
+			}
+
+			static StringHolder_Impl* Create(const char *str, size_t count) {
+				return new (Payload{ payloadSize(str, count) }) StringHolder_Impl(str, count);
+			}
+
+			const char* getRefName() {
+				return StringHolder::GetRefName();
+			}
+
+			bool queryRefById(void **const ppRef, unsigned long long id) {
+				return RefTable_Impl<StringHolder_Impl, StringHolder, Copyable, Ref>::query(this, ppRef, id);
+			}
+
+			bool copyById(void **const ppRef, unsigned long long id) {
+				if (id == StringHolder::RefID) return copyInterface(ppRef);
+				else return queryRefById(ppRef, id);
+			}
+
+			size_t getSize() {
+				return m_count;
+			}
+
+			const char* getString() {
+				return m_str;
+			}
+		};
+
+		class WStringHolder_Impl;
+
+		struct WStringTable_Impl {
+			std::mutex mutex;
+			std::unordered_multimap<UINT64, WStringHolder_Impl*> entries;
+
+			static WStringTable_Impl& get() {
+				static WStringTable_Impl *table = new WStringTable_Impl();
+				return *table;
+			}
+
+			static UINT64 hash(const wchar_t *str, size_t count) {
+				if (str == nullptr) return 0;
+				UINT64 res = 14695981039346656037ULL;
+				for (size_t i = 0; i < count; ++i) res = (res ^ static_cast<UINT64>(str[i])) * 1099511628211ULL;
+				return res;
+			}
+		};
+
+		class WStringHolder_Impl final : public virtual WStringHolder, public virtual Copyable_Impl {
+			wchar_t *m_str;
+			size_t m_count;
+			WStringHolder::Deleter m_deleter;
+			bool m_external;
+			UINT64 m_hash;
+			bool m_interned;
+
+			struct Payload {
+				size_t size;
+			};
+
+			static size_t payloadSize(const wchar_t *str, size_t count) {
+				return str == nullptr ? 0 : (count + 1) * sizeof(wchar_t);
+			}
+
+			static void* operator new(size_t size, Payload payload) {
+				return Pool_Impl::allocate(size + payload.size);
+			}
+
+			static void operator delete(void *ptr, Payload payload) {
+				Pool_Impl::release(ptr, sizeof(WStringHolder_Impl) + payload.size);
+			}
+
+			using Ref_Impl::operator delete;
+
+			WStringHolder_Impl(const wchar_t *str, size_t count, UINT64 hash, bool interned) : m_str(nullptr), m_count(0), m_deleter(nullptr), m_external(false),
+				m_hash(hash), m_interned(interned) {
+				if (str != nullptr) {
+					m_str = reinterpret_cast<wchar_t*>(reinterpret_cast<char*>(this) + sizeof(WStringHolder_Impl));
+					m_count = count;
+					std::memcpy(m_str, str, count * sizeof(wchar_t));
+					m_str[count] = 0;
+				}
+			}
+
+			WStringHolder_Impl(wchar_t *str, size_t count, WStringHolder::Deleter deleter) : m_str(str), m_count(str == nullptr ? 0 : count),
+				m_deleter(deleter), m_external(true), m_hash(WStringTable_Impl::hash(str, count)), m_interned(false) {
+				assert((str == nullptr || str[count] == 0) && "WStringHolder : external string must be null-terminated");
+			}
+
+			bool equals(const wchar_t *str, size_t count) {
+				if (m_str == nullptr || str == nullptr) return m_str == str;
+				return m_count == count && std::memcmp(m_str, str, count * sizeof(wchar_t)) == 0;
+			}
+
+			bool copyInterface(void **const ppRef) {
+				if (ppRef != nullptr) {
+					try {
+						if (m_external && m_deleter == nullptr) *ppRef = static_cast<WStringHolder*>(CreateExternal(m_str, m_count, nullptr));
+						else *ppRef = static_cast<WStringHolder*>(Create(m_str, m_count));
+					}
+					catch (...) {
+						return false;
+					}
+				}
+				return true;
+			}
+		protected:
+			void destroy() {
+				if (m_interned) {
+					auto &entries = WStringTable_Impl::get().entries;
+					auto range = entries.equal_range(m_hash);
+					for (auto it = range.first; it != range.second; ++it) {
+						if (it->second == this) {
+							entries.erase(it);
+							break;
+						}
+					}
+				}
+				size_t size = sizeof(WStringHolder_Impl) + (m_external ? 0 : payloadSize(m_str, m_count));
+				this->~WStringHolder_Impl();
+				Pool_Impl::release(this, size);
+			}
+		public:
+			~WStringHolder_Impl() {
+				if (m_deleter != nullptr) m_deleter(m_str);
+			}
+
+			static WStringHolder_Impl* CreateExternal(wchar_t *str, size_t count, WStringHolder::Deleter deleter) {
+				try {
+					return new (Payload{ 0 }) WStringHolder_Impl(str, count, deleter);
+				}
+				catch (...) {
+					if (deleter != nullptr) deleter(str);
+					throw;
+				}
+			}
+
+			static WStringHolder_Impl* Create(const wchar_t *str, size_t count) {
+				return new (Payload{ payloadSize(str, count) }) WStringHolder_Impl(str, count, WStringTable_Impl::hash(str, count), false);
+			}
+
+			static WStringHolder_Impl* Intern(const wchar_t *str, size_t count) {
+				UINT64 hash = WStringTable_Impl::hash(str, count);
+				WStringTable_Impl &table = WStringTable_Impl::get();
+				std::lock_guard<std::mutex> lock(table.mutex);
+
+				auto range = table.entries.equal_range(hash);
+				for (auto it = range.first; it != range.second; ++it) {
+					if (it->second->equals(str, count)) {
+						it->second->Ref_Impl::incRef();
+						return it->second;
+					}
+				}
+
+				WStringHolder_Impl *res = new (Payload{ payloadSize(str, count) }) WStringHolder_Impl(str, count, hash, true);
+				try {
+					table.entries.emplace(hash, res);
+				}
+				catch (...) {
+					res->m_interned = false;
+					res->destroy();
+					throw;
+				}
+				return res;
+			}
+
+			unsigned long long decRef() {
+				if (!m_interned) return Ref_Impl::decRef();
+				std::lock_guard<std::mutex> lock(WStringTable_Impl::get().mutex);
+				return Ref_Impl::decRef();
+			}
+
+			bool delRef() {
+				if (!m_interned) return Ref_Impl::delRef();
+				std::lock_guard<std::mutex> lock(WStringTable_Impl::get().mutex);
+				return Ref_Impl::delRef();
+			}
+
+			const char* getRefName() {
+				return WStringHolder::GetRefName();
+			}
+
+			bool queryRefById(void **const ppRef, unsigned long long id) {
+				return RefTable_Impl<WStringHolder_Impl, WStringHolder, Copyable, Ref>::query(this, ppRef, id);
+			}
+
+			bool copyById(void **const ppRef, unsigned long long id) {
+				if (id == WStringHolder::RefID) return copyInterface(ppRef);
+				else return queryRefById(ppRef, id);
+			}
+
+			size_t getSize() {
+				return m_count;
+			}
+
+			const wchar_t* getWString() {
+				return m_str;
+			}
+
+			UINT64 getHash() {
+				return m_hash;
+			}
+
+			bool isInterned() {
+				return m_interned;
+			}
+		};
+	}
+
+	namespace Exception {
+		class Exception_Impl : public virtual Exception, public virtual Ref_Impl {
+			Text::StringHolder *m_msg;
+		public:
+			~Exception_Impl() {
+				m_msg->decRef();
+			}
+
+			Exception_Impl(Text::StringHolder *msg) : m_msg(msg) {
+			}
+
+			const char* getRefName() const {
+				return Exception::GetRefName();
+			}
+
+			bool queryRefById(void **const ppRef, unsigned long long id) {
+				return RefTable_Impl<Exception_Impl, Exception, Ref>::query(this, ppRef, id);
+			}
+
+			const char* getMsg() {
+				return m_msg->getString();
+			}
+
+			void showMsg() {
+				IO::MsgBox::error("Exception", m_msg->getString());
+			}
+		};
+
+		class InvalidObjectException_Impl : public virtual InvalidObjectException, public virtual Exception_Impl {
+		public:
+			InvalidObjectException_Impl(Text::StringHolder *msg) : Exception_Impl(msg) {
+			}
+
+			const char* getRefName() const {
+				return InvalidObjectException::GetRefName();
+			}
+
+			bool queryRefById(void **const ppRef, unsigned long long id) {
+				return RefTable_Impl<InvalidObjectException_Impl, InvalidObjectException, Exception, Ref>::query(this, ppRef, id);
+			}
+
+			void showMsg() {
+				IO::MsgBox::error("InvalidObject", getMsg());
+			}
+		};
+	}
+
+	class WinClassStyle_Impl : public virtual WinClassStyle, public virtual Copyable_Impl {
+		UINT m_value = 0;
+
+		bool copyInterface(void **const ppRef) {
+			if (ppRef != nullptr) {
+				try {
+					*ppRef = static_cast<WinClassStyle*>(new WinClassStyle_Impl(m_value, getRefPolicy()));
+				}
+				catch (...) {
+					return false;
+				}
+			}
+			return true;
+		}
+	public:
+		static const char* GetRefName() {
+			return "WinFW::WinClassStyle_Impl";
+		}
+
+		static constexpr unsigned long long RefID = Hidden::RefHash("WinFW::WinClassStyle_Impl");
+
+		WinClassStyle_Impl(RefPolicy policy) : WinClassStyle_Impl(0, policy) {
+		}
+
+		WinClassStyle_Impl(UINT value, RefPolicy policy) : Ref_Impl(1ULL, policy), m_value(value) {
+		}
+
+		const char* getRefName() const {
+			return WinClassStyle::GetRefName();
+		}
+
+		bool queryRefById(void **const ppRef, unsigned long long id) {
+			if (id == RefID) {
+				if (ppRef != nullptr) *ppRef = this;
+				return true;
+			}
+			return RefTable_Impl<WinClassStyle_Impl, WinClassStyle, Copyable, Ref>::query(this, ppRef, id);
+		}
+
+		bool copyById(void **const ppRef, unsigned long long id) {
+			if (id == WinClassStyle::RefID) return copyInterface(ppRef);
+			else return queryRefById(ppRef, id);
+		}
+
+		virtual UINT getValue() {
+			return m_value;
+		}
+
+		WinClassStyle* clear() {
+			m_value = 0;
+			return this;
+		}
+
+		WinClassStyle* VRedraw() {
+			m_value |= CS_VREDRAW;
+			return this;
+		}
+
+		WinClassStyle* HRedraw() {
+			m_value |= CS_HREDRAW;
+			return this;
+		}
+
+		WinClassStyle* DBLCLKS() {
+			m_value |= CS_DBLCLKS;
+			return this;
+		}
+
+		WinClassStyle* OwnDC() {
+			m_value |= CS_OWNDC;
+			return this;
+		}
+
+		WinClassStyle* ClassDC() {
+			m_value |= CS_CLASSDC;
+			return this;
+		}
+
+		WinClassStyle* ParentDC() {
+			m_value |= CS_PARENTDC;
+			return this;
+		}
+
+		WinClassStyle* NoClose() {
+			m_value |= CS_NOCLOSE;
+			return this;
+		}
+
+		WinClassStyle* SaveBits() {
+			m_value |= CS_SAVEBITS;
+			return this;
+		}
+
+		WinClassStyle* ByteAlignClient() {
+			m_value |= CS_BYTEALIGNCLIENT;
+			return this;
+		}
+
+		WinClassStyle* ByteAlignWindow() {
+			m_value |= CS_BYTEALIGNWINDOW;
+			return this;
+		}
+
+		WinClassStyle* GlobalClass() {
+			m_value |= CS_GLOBALCLASS;
+			return this;
+		}
+
+		WinClassStyle* DropShadow() {
+			m_value |= CS_DROPSHADOW;
+			return this;
+		}
+	};
+
+	class WinClassConfig_Impl : public virtual WinClassConfig, public virtual Copyable_Impl {
+		UINT m_style;
+		int	m_cbClsExtra;
+		int	m_cbWndExtra;
+		HICON m_hIcon;
+		HCURSOR	m_hCursor;
+		HBRUSH m_hbrBackground;
+		HICON m_hIconSm;
+		Text::WStringHolder *m_lpszMenuName;
+		Text::WStringHolder *m_lpszClassName;
+		WNDPROC m_lpfnWndProc;
+
+		bool copyInterface(void **const ppRef) {
+			if (ppRef != nullptr) {
+				try {
+					m_lpszClassName->incRef();
+					m_lpszMenuName->incRef();
+					*ppRef = static_cast<WinClassConfig*>(new WinClassConfig_Impl(m_style, m_cbClsExtra, m_cbWndExtra, m_hIcon, m_hCursor,
+						m_hbrBackground, m_hIconSm, m_lpszMenuName, m_lpszClassName, m_lpfnWndProc, getRefPolicy()));
+				}
+				catch (...) {
+					m_lpszClassName->decRef();
+					m_lpszMenuName->decRef();
+					return false;
+				}
+			}
+			return true;
+		}
+	public:
+		static const char* GetRefName() {
+			return "WinFW::WinClassConfig_Impl";
+		}
+
+		static constexpr unsigned long long RefID = Hidden::RefHash("WinFW::WinClassConfig_Impl");
+
+		~WinClassConfig_Impl() {
+			m_lpszMenuName->decRef();
+			m_lpszClassName->decRef();
+		}
+
+		WinClassConfig_Impl(Text::WStringHolder *lpszClassName, WNDPROC lpfnWndProc, RefPolicy policy) : WinClassConfig_Impl(CS_HREDRAW | CS_VREDRAW, 0, 0, nullptr, 
+			LoadCursorW(NULL, IDC_ARROW), reinterpret_cast<HBRUSH>(COLOR_WINDOW + 1), nullptr, Text::WStringHolder::Intern(nullptr),
+			lpszClassName, lpfnWndProc, policy) {
 		}
 
 		WinClassConfig_Impl(UINT style, int cbClsExtra,	int cbWndExtra, HICON hIcon, HCURSOR hCursor, HBRUSH hbrBackground, 
-			HICON hIconSm, Text::WStringHolder *lpszMenuName, Text::WStringHolder *lpszClassName, WNDPROC lpfnWndProc) : m_style(style),
+			HICON hIconSm, Text::WStringHolder *lpszMenuName, Text::WStringHolder *lpszClassName, WNDPROC lpfnWndProc, RefPolicy policy) : Ref_Impl(1ULL, policy), m_style(style),
 			m_cbClsExtra(cbClsExtra), m_cbWndExtra(cbWndExtra), m_hIcon(hIcon), m_hCursor(hCursor), m_hbrBackground(hbrBackground),
 			m_hIconSm(hIconSm), m_lpszMenuName(lpszMenuName), m_lpszClassName(lpszClassName), m_lpfnWndProc(lpfnWndProc) {
 		}
 
-		const char* getRefName() const {
-			return WinClassConfig::GetRefName();
+		const char* getRefName() const {
+			return WinClassConfig::GetRefName();
+		}
+
+		bool queryRefById(void **const ppRef, unsigned long long id) {
+			if (id == RefID) {
+				if (ppRef != nullptr) *ppRef = this;
+				return true;
+			}
+			return RefTable_Impl<WinClassConfig_Impl, WinClassConfig, Copyable, Ref>::query(this, ppRef, id);
+		}
+
+		bool copyById(void **const ppRef, unsigned long long id) {
+			if (id == WinClassConfig::RefID) return copyInterface(ppRef);
+			else return queryRefById(ppRef, id);
+		}
+
+		WinClassConfig* setWndProc(WNDPROC lpfnWndProc) {
+			m_lpfnWndProc = lpfnWndProc;
+			return this;
+		}
+
+		WinClassConfig* setClassName(LPCWSTR lpszClassName) {
+			m_lpszClassName->decRef();
+			m_lpszClassName = Text::WStringHolder::Intern(lpszClassName);
+			return this;
+		}
+
+		WinClassConfig* setStyle(WinClassStyle *&style) {
+			WinClassStyle_Impl *buff;
+			if (!style->queryRefById(reinterpret_cast<void**>(&buff), WinClassStyle_Impl::RefID)) throw Exception::InvalidObjectException::New("WinClassStyle : incompatible");
+			m_style = buff->getValue();
+			return this;
+		}
+
+		WinClassConfig* setStyle(WinClassStyle *&&style) {
+			WinClassConfig *buff = setStyle(static_cast<WinClassStyle*&>(style));
+			style->decRef();
+			return buff;
+		}
+
+		WinClassConfig* setStyle(WinClassStyleFlags style) {
+			m_style = style.get();
+			return this;
+		}
+
+		WinClassConfig* setClsExtraBytes(int cbClsExtra) {
+			m_cbClsExtra = cbClsExtra;
+			return this;
+		}
+
+		WinClassConfig* setWndExtraBytes(int cbWndExtra) {
+			m_cbWndExtra = cbWndExtra;
+			return this;
+		}
+
+		WinClassConfig* setIcon(HICON hIcon) {
+			m_hIcon = hIcon;
+			return this;
+		}
+
+		WinClassConfig* setCursor(HCURSOR hCursor) {
+			m_hCursor = hCursor;
+			return this;
+		}
+
+		WinClassConfig* setMenuName(LPCWSTR lpszMenuName) {
+			m_lpszMenuName->decRef();
+			m_lpszMenuName = Text::WStringHolder::Intern(lpszMenuName);
+			return this;
+		}
+
+		WinClassConfig* setBackgroundColor(HBRUSH hbrBackground) {
+			m_hbrBackground = hbrBackground;
+			return this;
+		}
+
+		WinClassConfig* setIconSm(HICON hIconSm) {
+			m_hIconSm = hIconSm;
+			return this;
+		}
+
+		virtual UINT getStyle() {
+			return m_style;
+		}
+
+		virtual int getClsExtraBytes() {
+			return m_cbClsExtra;
+		}
+
+		virtual int getWndExtraBytes() {
+			return m_cbWndExtra;
+		}
+
+		virtual HICON getIcon() {
+			return m_hIcon;
+		}
+
+		virtual HCURSOR getCursor() {
+			return m_hCursor;
+		}
+
+		virtual HBRUSH getBackgroundColor() {
+			return m_hbrBackground;
+		}
+
+		virtual HICON getIconSm() {
+			return m_hIconSm;
+		}
+
+		virtual LPCWSTR getMenuName() {
+			return m_lpszMenuName->getWString();
+		}
+
+		virtual WNDPROC getWndProc() {
+			return m_lpfnWndProc;
+		}
+
+		virtual LPCWSTR getClassName() {
+			return m_lpszClassName->getWString();
+		}
+
+		Text::WStringHolder* getClassNameHolder() {
+			return m_lpszClassName;
+		}
+	};
+
+	class WinClass_Impl : public virtual WinClass, public virtual Ref_Impl {
+		Text::WStringHolder *m_name;
+	public:
+		~WinClass_Impl() {
+			UnregisterClassW(m_name->getWString(), g_hInstance);
+			m_name->decRef();
+		}
+
+		WinClass_Impl(Text::WStringHolder *name) : m_name(name) {
+		}
+
+		const char* getRefName() const {
+			return WinClassConfig::GetRefName();
+		}
+
+		bool queryRefById(void **const ppRef, unsigned long long id) {
+			return RefTable_Impl<WinClass_Impl, WinClass, Ref>::query(this, ppRef, id);
+		}
+
+		LPCWSTR getName() const {
+			return m_name->getWString();
+		}
+	};
+
+	class WindowStyle_Impl : public virtual WindowStyle, public virtual Copyable_Impl {
+		DWORD m_style = 0;
+
+		bool copyInterface(void **const ppRef) {
+			if (ppRef != nullptr) {
+				try {
+					*ppRef = static_cast<WindowStyle*>(new WindowStyle_Impl(m_style, getRefPolicy()));
+				}
+				catch (...) {
+					return false;
+				}
+			}
+			return true;
+		}
+	public:
+		static const char* GetRefName() {
+			return "WinFW::WindowStyle_Impl";
+		}
+
+		static constexpr unsigned long long RefID = Hidden::RefHash("WinFW::WindowStyle_Impl");
+
+		WindowStyle_Impl(RefPolicy policy) : WindowStyle_Impl(0, policy) {
+		}
+
+		WindowStyle_Impl(DWORD style, RefPolicy policy) : Ref_Impl(1ULL, policy), m_style(style) {
+		}
+
+		const char* getRefName() const {
+			return WindowStyle::GetRefName();
+		}
+
+		bool queryRefById(void **const ppRef, unsigned long long id) {
+			if (id == RefID) {
+				if (ppRef != nullptr) *ppRef = this;
+				return true;
+			}
+			return RefTable_Impl<WindowStyle_Impl, WindowStyle, Copyable, Ref>::query(this, ppRef, id);
+		}
+
+		bool copyById(void **const ppRef, unsigned long long id) {
+			if (id == WindowStyle::RefID) return copyInterface(ppRef);
+			else return queryRefById(ppRef, id);
+		}
+
+		virtual DWORD getValue() {
+			return m_style;
+		}
+
+		WindowStyle* clear() {
+			m_style = 0;
+			return this;
+		}
+
+		WindowStyle* Caption() {
+			m_style |= WS_CAPTION;
+			return this;
+		}
+
+		WindowStyle* Child() {
+			m_style |= WS_CHILD;
+			return this;
+		}
+
+		WindowStyle* ChildWindow() {
+			m_style |= WS_CHILDWINDOW;
+			return this;
+		}
+
+		WindowStyle* ClipChildren() {
+			m_style |= WS_CLIPCHILDREN;
+			return this;
+		}
+
+		WindowStyle* ClipSiblings() {
+			m_style |= WS_CLIPSIBLINGS;
+			return this;
 		}
 
-		WinClassConfig* setWndProc(WNDPROC lpfnWndProc) {
-			m_lpfnWndProc = lpfnWndProc;
+		WindowStyle* Disabled() {
+			m_style |= WS_DISABLED;
 			return this;
 		}
 
-		WinClassConfig* setClassName(LPCWSTR lpszClassName) {
-			m_lpszClassName->decRef();
-			m_lpszClassName = Text::WStringHolder::New(lpszClassName);
+		WindowStyle* DLGFrame() {
+			m_style |= WS_DLGFRAME;
 			return this;
 		}
 
-		WinClassConfig* setStyle(WinClassStyle *&style) {
-			WinClassStyle_Impl *buff;
-			if (!style->queryRef(reinterpret_cast<void**>(&buff), WinClassStyle_Impl::GetRefName(), true)) throw Exception::InvalidObjectException::New("WinClassStyle : incompatible");
-			m_style = buff->getValue();
+		WindowStyle* Group() {
+			m_style |= WS_GROUP;
 			return this;
 		}
 
-		WinClassConfig* setStyle(WinClassStyle *&&style) {
-			WinClassConfig *buff = setStyle(static_cast<WinClassStyle*&>(style));
-			style->decRef();
-			return buff;
+		WindowStyle* HScroll() {
+			m_style |= WS_HSCROLL;
+			return this;
 		}
 
-		WinClassConfig* setClsExtraBytes(int cbClsExtra) {
-			m_cbClsExtra = cbClsExtra;
+		WindowStyle* Iconic() {
+			m_style |= WS_ICONIC;
 			return this;
 		}
 
-		WinClassConfig* setWndExtraBytes(int cbWndExtra) {
-			m_cbWndExtra = cbWndExtra;
+		WindowStyle* Maximize() {
+			m_style |= WS_MAXIMIZE;
 			return this;
 		}
 
-		WinClassConfig* setIcon(HICON hIcon) {
-			m_hIcon = hIcon;
+		WindowStyle* MaximizeBox() {
+			m_style |= WS_MAXIMIZEBOX;
 			return this;
 		}
 
-		WinClassConfig* setCursor(HCURSOR hCursor) {
-			m_hCursor = hCursor;
+		WindowStyle* Minimize() {
+			m_style |= WS_MINIMIZE;
 			return this;
 		}
 
-		WinClassConfig* setMenuName(LPCWSTR lpszMenuName) {
-			m_lpszMenuName->decRef();
-			m_lpszMenuName = Text::WStringHolder::New(lpszMenuName);
+		WindowStyle* MinimizeBox() {
+			m_style |= WS_MINIMIZEBOX;
 			return this;
 		}
 
-		WinClassConfig* setBackgroundColor(HBRUSH hbrBackground) {
-			m_hbrBackground = hbrBackground;
+		WindowStyle* Overlapped() {
+			m_style |= WS_OVERLAPPED;
 			return this;
 		}
 
-		WinClassConfig* setIconSm(HICON hIconSm) {
-			m_hIconSm = hIconSm;
+		WindowStyle* OverlappedWindow() {
+			m_style |= WS_OVERLAPPED;
 			return this;
 		}
 
-		virtual UINT getStyle() {
-			return m_style;
+		WindowStyle* PopUp() {
+			m_style |= WS_POPUP;
+			return this;
 		}
 
-		virtual int getClsExtraBytes() {
-			return m_cbClsExtra;
+		WindowStyle* PopUpWindow() {
+			m_style |= WS_POPUPWINDOW;
+			return this;
 		}
 
-		virtual int getWndExtraBytes() {
-			return m_cbWndExtra;
+		WindowStyle* SizeBox() {
+			m_style |= WS_SIZEBOX;
+			return this;
 		}
 
-		virtual HICON getIcon() {
-			return m_hIcon;
+		WindowStyle* SysMenu() {
+			m_style |= WS_SYSMENU;
+			return this;
 		}
 
-		virtual HCURSOR getCursor() {
-			return m_hCursor;
+		WindowStyle* TabStop() {
+			m_style |= WS_TABSTOP;
+			return this;
 		}
 
-		virtual HBRUSH getBackgroundColor() {
-			return m_hbrBackground;
+		WindowStyle* ThickFrame() {
+			m_style |= WS_THICKFRAME;
+			return this;
 		}
 
-		virtual HICON getIconSm() {
-			return m_hIconSm;
+		WindowStyle* Tiled() {
+			m_style |= WS_TILED;
+			return this;
 		}
 
-		virtual LPCWSTR getMenuName() {
-			return m_lpszMenuName->getWString();
+		WindowStyle* TiledWindow() {
+			m_style |= WS_TILEDWINDOW;
+			return this;
 		}
 
-		virtual WNDPROC getWndProc() {
-			return m_lpfnWndProc;
+		WindowStyle* Visible() {
+			m_style |= WS_VISIBLE;
+			return this;
 		}
 
-		virtual LPCWSTR getClassName() {
-			return m_lpszClassName->getWString();
+		WindowStyle* VScroll() {
+			m_style |= WS_VSCROLL;
+			return this;
 		}
 	};
 
-	class WinClass_Impl : public virtual WinClass, public virtual Ref_Impl {
-		Text::WStringHolder *m_name;
+	class WindowExStyle_Impl : public virtual WindowExStyle, public virtual Copyable_Impl {
+		DWORD m_exStyle = 0;
 
-		bool setInterface(void **const ppRef) {
+		bool copyInterface(void **const ppRef) {
 			if (ppRef != nullptr) {
-				incRef();
-				*ppRef = static_cast<WinClass*>(this);
+				try {
+					*ppRef = static_cast<WindowExStyle*>(new WindowExStyle_Impl(m_exStyle, getRefPolicy()));
+				}
+				catch (...) {
+					return false;
+				}
 			}
 			return true;
 		}
-	protected:
-		bool queryRefByCmpPtr(void **const ppRef, const char *id) {
-			if (id == WinClass::GetRefName()) return setInterface(ppRef);
-			else return Ref_Impl::queryRefByCmpPtr(ppRef, id);
+	public:
+		static const char* GetRefName() {
+			return "WinFW::WindowExStyle_Impl";
 		}
 
-		bool queryRefByCmpStr(void **const ppRef, const char *id) {
-			if (std::strcmp(id, WinClass::GetRefName()) == 0) return setInterface(ppRef);
-			else return Ref_Impl::queryRefByCmpStr(ppRef, id);
+		static constexpr unsigned long long RefID = Hidden::RefHash("WinFW::WindowExStyle_Impl");
+
+		WindowExStyle_Impl(RefPolicy policy) : WindowExStyle_Impl(0, policy) {
 		}
-	public:
-		~WinClass_Impl() {
-			UnregisterClassW(m_name->getWString(), g_hInstance);
-			m_name->decRef();
+
+		WindowExStyle_Impl(DWORD exStyle, RefPolicy policy) : Ref_Impl(1ULL, policy), m_exStyle(exStyle) {
+		}
+
+		const char* getRefName() const {
+			return WindowExStyle::GetRefName();
+		}
+
+		bool queryRefById(void **const ppRef, unsigned long long id) {
+			if (id == RefID) {
+				if (ppRef != nullptr) *ppRef = this;
+				return true;
+			}
+			return RefTable_Impl<WindowExStyle_Impl, WindowExStyle, Copyable, Ref>::query(this, ppRef, id);
+		}
+
+		bool copyById(void **const ppRef, unsigned long long id) {
+			if (id == WindowExStyle::RefID) return copyInterface(ppRef);
+			else return queryRefById(ppRef, id);
+		}
+
+		virtual DWORD getValue() {
+			return m_exStyle;
+		}
+
+		WindowExStyle* clear() {
+			m_exStyle = 0;
+			return this;
+		}
+
+		WindowExStyle* AcceptFiles() {
+			m_exStyle |= WS_EX_ACCEPTFILES;
+			return this;
+		}
+
+		WindowExStyle* AppWindow() {
+			m_exStyle |= WS_EX_APPWINDOW;
+			return this;
+		}
+
+		WindowExStyle* ClientEdge() {
+			m_exStyle |= WS_EX_CLIENTEDGE;
+			return this;
+		}
+
+		WindowExStyle* Composited() {
+			m_exStyle |= WS_EX_COMPOSITED;
+			return this;
+		}
+
+		WindowExStyle* ContextHelp() {
+			m_exStyle |= WS_EX_CONTEXTHELP;
+			return this;
+		}
+
+		WindowExStyle* ControlParent() {
+			m_exStyle |= WS_EX_CONTROLPARENT;
+			return this;
+		}
+
+		WindowExStyle* DLGModalFrame() {
+			m_exStyle |= WS_EX_DLGMODALFRAME;
+			return this;
+		}
+
+		WindowExStyle* Layered() {
+			m_exStyle |= WS_EX_LAYERED;
+			return this;
+		}
+
+		WindowExStyle* LayoutRTL() {
+			m_exStyle |= WS_EX_LAYOUTRTL;
+			return this;
+		}
+
+		WindowExStyle* Left() {
+			m_exStyle |= WS_EX_LEFT;
+			return this;
+		}
+
+		WindowExStyle* LeftScrollBar() {
+			m_exStyle |= WS_EX_LEFTSCROLLBAR;
+			return this;
+		}
+
+		WindowExStyle* LTRReadding() {
+			m_exStyle |= WS_EX_LTRREADING;
+			return this;
+		}
+
+		WindowExStyle* MDIChild() {
+			m_exStyle |= WS_EX_MDICHILD;
+			return this;
+		}
+
+		WindowExStyle* NoActivate() {
+			m_exStyle |= WS_EX_NOACTIVATE;
+			return this;
+		}
+
+		WindowExStyle* NoInheriteLayout() {
+			m_exStyle |= WS_EX_NOINHERITLAYOUT;
+			return this;
+		}
+
+		WindowExStyle* NoParentNotify() {
+			m_exStyle |= WS_EX_NOPARENTNOTIFY;
+			return this;
+		}
+
+		WindowExStyle* NoRedirectBitmap() {
+			m_exStyle |= WS_EX_NOREDIRECTIONBITMAP;
+			return this;
+		}
+
+		WindowExStyle* OverlappedWindow() {
+			m_exStyle |= WS_EX_OVERLAPPEDWINDOW;
+			return this;
+		}
+
+		WindowExStyle* PaletteWindow() {
+			m_exStyle |= WS_EX_PALETTEWINDOW;
+			return this;
+		}
+
+		WindowExStyle* Right() {
+			m_exStyle |= WS_EX_RIGHT;
+			return this;
+		}
+
+		WindowExStyle* RightScrollBar() {
+			m_exStyle |= WS_EX_RIGHTSCROLLBAR;
+			return this;
+		}
+
+		WindowExStyle* RTLReadding() {
+			m_exStyle |= WS_EX_RTLREADING;
+			return this;
+		}
+
+		WindowExStyle* StaticEdge() {
+			m_exStyle |= WS_EX_STATICEDGE;
+			return this;
 		}
 
-		WinClass_Impl(Text::WStringHolder *name) : m_name(name) {
+		WindowExStyle* ToolWindow() {
+			m_exStyle |= WS_EX_TOOLWINDOW;
+			return this;
 		}
 
-		const char* getRefName() const {
-			return WinClassConfig::GetRefName();
+		WindowExStyle* TopMost() {
+			m_exStyle |= WS_EX_TOPMOST;
+			return this;
 		}
 
-		LPCWSTR getName() const {
-			return m_name->getWString();
+		WindowExStyle* Transparent() {
+			m_exStyle |= WS_EX_TRANSPARENT;
+			return this;
 		}
-	};
-
-	class WindowStyle_Impl : public virtual WindowStyle, public virtual Copyable_Impl {
-		DWORD m_style = 0;
 
-		bool setInterface(void **const ppRef) {
-			if (ppRef != nullptr) {
-				incRef();
-				*ppRef = static_cast<WindowStyle*>(this);
-			}
-			return true;
+		WindowExStyle* WindowEdge() {
+			m_exStyle |= WS_EX_WINDOWEDGE;
+			return this;
 		}
+	};
+
+	class WindowConfig_Impl : public virtual WindowConfig, public virtual Copyable_Impl {
+		DWORD m_dwExStyle;
+		Text::WStringHolder *m_lpWindowName;
+		DWORD m_dwStyle;
+		int m_x;
+		int m_y;
+		HWND m_hWndParent;
+		HMENU m_hMenu;
+		LPVOID m_lpParam;
+		int m_width;
+		int m_height;
+		WinClass *m_winClass;
 
 		bool copyInterface(void **const ppRef) {
 			if (ppRef != nullptr) {
 				try {
-					*ppRef = static_cast<WindowStyle*>(new WindowStyle_Impl(m_style));
+					m_winClass->incRef();
+					m_lpWindowName->incRef();
+					*ppRef = static_cast<WindowConfig*>(new WindowConfig_Impl(m_dwExStyle, m_lpWindowName, m_dwStyle, m_x, m_y, m_hWndParent,
+						m_hMenu, m_lpParam, m_width, m_height, m_winClass, getRefPolicy()));
 				}
 				catch (...) {
+					m_lpWindowName->decRef();
+					m_winClass->decRef();
 					return false;
 				}
 			}
 			return true;
 		}
-	protected:
-		bool queryRefByCmpPtr(void **const ppRef, const char *id) {
-			if (id == WindowStyle::GetRefName()) return setInterface(ppRef);
-			else return Copyable_Impl::queryRefByCmpPtr(ppRef, id);
+	public:
+		static const char* GetRefName() {
+			return "WinFW::WindowConfig_Impl";
 		}
 
-		bool queryRefByCmpStr(void **const ppRef, const char *id) {
-			if (std::strcmp(id, WindowStyle::GetRefName()) == 0) return setInterface(ppRef);
-			else return Copyable_Impl::queryRefByCmpStr(ppRef, id);
-		}
+		static constexpr unsigned long long RefID = Hidden::RefHash("WinFW::WindowConfig_Impl");
 
-		bool copyByCmpPtr(void **const ppRef, const char *id) {
-			if (id == WindowStyle::GetRefName()) return copyInterface(ppRef);
-			else return Copyable_Impl::copyByCmpPtr(ppRef, id);
+		~WindowConfig_Impl() {
+			m_winClass->decRef();
+			m_lpWindowName->decRef();
 		}
 
-		bool copyByCmpStr(void **const ppRef, const char *id) {
-			if (std::strcmp(id, WindowStyle::GetRefName()) == 0) return copyInterface(ppRef);
-			else return Copyable_Impl::copyByCmpStr(ppRef, id);
-		}
-	public:
-		static const char* GetRefName() {
-			return "WinFW::WindowStyle_Impl";
+		WindowConfig_Impl(WinClass *winClass, int width, int height, RefPolicy policy) : WindowConfig_Impl(0, Text::WStringHolder::Intern(nullptr),
+			WS_SYSMENU | WS_MINIMIZEBOX | WS_CAPTION, CW_USEDEFAULT, CW_USEDEFAULT, nullptr, nullptr, nullptr, width, height, winClass, policy) {
 		}
 
-		WindowStyle_Impl() : WindowStyle_Impl(0) {
+		WindowConfig_Impl(DWORD dwExStyle, Text::WStringHolder *lpWindowName, DWORD dwStyle, int x, int y, HWND hWndParent, HMENU hMenu,
+			LPVOID lpParam, int width, int height, WinClass *winClass, RefPolicy policy) : Ref_Impl(1ULL, policy), m_dwExStyle(dwExStyle), m_lpWindowName(lpWindowName), m_dwStyle(dwStyle), m_x(x), m_y(y),
+			m_hWndParent(hWndParent), m_hMenu(hMenu), m_lpParam(lpParam), m_width(width), m_height(height), m_winClass(winClass) {
 		}
 
-		WindowStyle_Impl(DWORD style) : m_style(style) {
+		const char* getRefName() const {
+			return WindowConfig::GetRefName();
 		}
 
-		const char* getRefName() const {
-			return WindowStyle::GetRefName();
+		bool queryRefById(void **const ppRef, unsigned long long id) {
+			if (id == RefID) {
+				if (ppRef != nullptr) *ppRef = this;
+				return true;
+			}
+			return RefTable_Impl<WindowConfig_Impl, WindowConfig, Copyable, Ref>::query(this, ppRef, id);
 		}
 
-		virtual DWORD getValue() {
-			return m_style;
+		bool copyById(void **const ppRef, unsigned long long id) {
+			if (id == WindowConfig::RefID) return copyInterface(ppRef);
+			else return queryRefById(ppRef, id);
 		}
 
-		WindowStyle* clear() {
-			m_style = 0;
+		WindowConfig* setX(int x) {
+			m_x = x;
 			return this;
-		}
+		} 
 
-		WindowStyle* Caption() {
-			m_style |= WS_CAPTION;
+		WindowConfig* setY(int y) {
+			m_y = y;
 			return this;
 		}
 
-		WindowStyle* Child() {
-			m_style |= WS_CHILD;
+		WindowConfig* setWidth(int width) {
+			m_width = width;
 			return this;
 		}
 
-		WindowStyle* ChildWindow() {
-			m_style |= WS_CHILDWINDOW;
+		WindowConfig* setHeight(int height) {
+			m_height = height;
 			return this;
 		}
 
-		WindowStyle* ClipChildren() {
-			m_style |= WS_CLIPCHILDREN;
+		WindowConfig* setWinClass(WinClass *&winClass) {
+			m_winClass = winClass;
 			return this;
 		}
 
-		WindowStyle* ClipSiblings() {
-			m_style |= WS_CLIPSIBLINGS;
-			return this;
+		WindowConfig* setWinClass(WinClass *&&winClass) {
+			WindowConfig *buff = setWinClass(static_cast<WinClass*&>(winClass));
+			winClass->decRef();
+			return buff;
 		}
 
-		WindowStyle* Disabled() {
-			m_style |= WS_DISABLED;
+		WindowConfig* setStyle(WindowStyle *&style) {
+			WindowStyle_Impl *buff;
+			if (!style->queryRefById(reinterpret_cast<void**>(&buff), WindowStyle_Impl::RefID)) throw Exception::InvalidObjectException::New("WindowStyle : incompatible");
+			m_dwStyle = buff->getValue();
 			return this;
 		}
 
-		WindowStyle* DLGFrame() {
-			m_style |= WS_DLGFRAME;
-			return this;
+		WindowConfig* setStyle(WindowStyle *&&style) {
+			WindowConfig *buff = setStyle(static_cast<WindowStyle*&>(style));
+			style->decRef();
+			return buff;
 		}
 
-		WindowStyle* Group() {
-			m_style |= WS_GROUP;
+		WindowConfig* setStyle(WindowStyleFlags style) {
+			m_dwStyle = style.get();
 			return this;
 		}
 
-		WindowStyle* HScroll() {
-			m_style |= WS_HSCROLL;
+		WindowConfig* setExStyle(WindowExStyle *&exStyle) {
+			WindowExStyle_Impl *buff;
+			if (!exStyle->queryRefById(reinterpret_cast<void**>(&buff), WindowExStyle_Impl::RefID)) throw Exception::InvalidObjectException::New("WindowExStyle : incompatible");
+			m_dwExStyle = buff->getValue();
 			return this;
 		}
 
-		WindowStyle* Iconic() {
-			m_style |= WS_ICONIC;
-			return this;
+		WindowConfig* setExStyle(WindowExStyle *&&exStyle) {
+			WindowConfig *buff = setExStyle(static_cast<WindowExStyle*&>(exStyle));
+			exStyle->decRef();
+			return buff;
 		}
 
-		WindowStyle* Maximize() {
-			m_style |= WS_MAXIMIZE;
+		WindowConfig* setExStyle(WindowExStyleFlags exStyle) {
+			m_dwExStyle = exStyle.get();
 			return this;
 		}
 
-		WindowStyle* MaximizeBox() {
-			m_style |= WS_MAXIMIZEBOX;
+		WindowConfig* setParent(HWND hWndParent) {
+			m_hWndParent = hWndParent;
 			return this;
 		}
 
-		WindowStyle* Minimize() {
-			m_style |= WS_MINIMIZE;
+		WindowConfig* setMenu(HMENU hMenu) {
+			m_hMenu = hMenu;
 			return this;
 		}
 
-		WindowStyle* MinimizeBox() {
-			m_style |= WS_MINIMIZEBOX;
+		WindowConfig* setLpParam(LPVOID lpParam) {
+			m_lpParam = lpParam;
 			return this;
 		}
 
-		WindowStyle* Overlapped() {
-			m_style |= WS_OVERLAPPED;
+		WindowConfig* setTitle(LPCWSTR title) {
+			m_lpWindowName->decRef();
+			m_lpWindowName = Text::WStringHolder::Intern(title);
 			return this;
 		}
 
-		WindowStyle* OverlappedWindow() {
-			m_style |= WS_OVERLAPPED;
-			return this;
+		virtual int getX() {
+			return m_x;
 		}
 
-		WindowStyle* PopUp() {
-			m_style |= WS_POPUP;
-			return this;
+		virtual int getY() {
+			return m_y;
 		}
 
-		WindowStyle* PopUpWindow() {
-			m_style |= WS_POPUPWINDOW;
-			return this;
+		virtual int getWidth() {
+			return m_width;
 		}
 
-		WindowStyle* SizeBox() {
-			m_style |= WS_SIZEBOX;
-			return this;
+		virtual int getHeight() {
+			return m_height;
 		}
 
-		WindowStyle* SysMenu() {
-			m_style |= WS_SYSMENU;
-			return this;
+		virtual WinClass* getWinClass() {
+			return m_winClass;
 		}
 
-		WindowStyle* TabStop() {
-			m_style |= WS_TABSTOP;
-			return this;
+		virtual DWORD getStyle() {
+			return m_dwStyle;
 		}
 
-		WindowStyle* ThickFrame() {
-			m_style |= WS_THICKFRAME;
-			return this;
+		virtual DWORD getExStyle() {
+			return m_dwExStyle;
 		}
 
-		WindowStyle* Tiled() {
-			m_style |= WS_TILED;
-			return this;
+		virtual HWND getParent() {
+			return m_hWndParent;
 		}
 
-		WindowStyle* TiledWindow() {
-			m_style |= WS_TILEDWINDOW;
-			return this;
+		virtual HMENU getMenu() {
+			return m_hMenu;
 		}
 
-		WindowStyle* Visible() {
-			m_style |= WS_VISIBLE;
-			return this;
+		virtual LPVOID getLpParam() {
+			return m_lpParam;
 		}
 
-		WindowStyle* VScroll() {
-			m_style |= WS_VSCROLL;
-			return this;
+		virtual LPCWSTR getTitle() {
+			return m_lpWindowName->getWString();
 		}
 	};
 
-	class WindowExStyle_Impl : public virtual WindowExStyle, public virtual Copyable_Impl {
-		DWORD m_exStyle = 0;
-
-		bool setInterface(void **const ppRef) {
-			if (ppRef != nullptr) {
-				incRef();
-				*ppRef = static_cast<WindowExStyle*>(this);
-			}
-			return true;
-		}
+	class Window_Impl : public virtual Window, public virtual Ref_Impl, private Coalescer_Impl {
+		enum Coalesced : UINT {
+			CoalescedMove,
+			CoalescedSize,
+			CoalescedMouseMove,
+			CoalescedWheel,
+			CoalescedHWheel,
+			NumCoalesced
+		};
 
-		bool copyInterface(void **const ppRef) {
-			if (ppRef != nullptr) {
-				try {
-					*ppRef = static_cast<WindowExStyle*>(new WindowExStyle_Impl(m_exStyle));
-				}
-				catch (...) {
-					return false;
-				}
-			}
-			return true;
-		}
-	protected:
-		bool queryRefByCmpPtr(void **const ppRef, const char *id) {
-			if (id == WindowExStyle::GetRefName()) return setInterface(ppRef);
-			else return Copyable_Impl::queryRefByCmpPtr(ppRef, id);
-		}
+		struct Handler {
+			MessageHandler func;
+			void *ctx;
+		};
 
-		bool queryRefByCmpStr(void **const ppRef, const char *id) {
-			if (std::strcmp(id, WindowExStyle::GetRefName()) == 0) return setInterface(ppRef);
-			else return Copyable_Impl::queryRefByCmpStr(ppRef, id);
-		}
+		struct SetHandlerArgs {
+			Window_Impl *window;
+			UINT message;
+			Handler handler;
+			bool res;
+		};
 
-		bool copyByCmpPtr(void **const ppRef, const char *id) {
-			if (id == WindowExStyle::GetRefName()) return copyInterface(ppRef);
-			else return Copyable_Impl::copyByCmpPtr(ppRef, id);
+		HWND m_hWnd;
+		WinClass *m_winClass;
+		WNDPROC m_classProc;
+		bool m_installed;
+		std::vector<Handler> m_handlers;
+		std::unordered_map<UINT, Handler> m_userHandlers;
+		WindowMessage m_held[NumCoalesced];
+		UINT m_heldCount[NumCoalesced];
+		UINT m_heldMask;
+		bool m_sizing;
+
+		const Handler* findHandler(UINT message) const {
+			if (message < WM_USER) {
+				if (m_handlers.empty() || m_handlers[message].func == nullptr) return nullptr;
+				return &m_handlers[message];
+			}
+			if (m_userHandlers.empty()) return nullptr;
+			auto it = m_userHandlers.find(message);
+			return it == m_userHandlers.end() ? nullptr : &it->second;
+		}
+
+		LRESULT dispatch(const WindowMessage &msg) {
+			const Handler *handler = findHandler(msg.message);
+			return handler != nullptr ? handler->func(this, msg, handler->ctx) : callDefault(msg);
+		}
+
+		static int coalescedIndex(UINT message) {
+			switch (message) {
+			case WM_MOVE:
+				return CoalescedMove;
+			case WM_SIZE:
+				return CoalescedSize;
+			case WM_MOUSEMOVE:
+				return CoalescedMouseMove;
+			case WM_MOUSEWHEEL:
+				return CoalescedWheel;
+			case WM_MOUSEHWHEEL:
+				return CoalescedHWheel;
+			default:
+				return -1;
+			}
 		}
 
-		bool copyByCmpStr(void **const ppRef, const char *id) {
-			if (std::strcmp(id, WindowExStyle::GetRefName()) == 0) return copyInterface(ppRef);
-			else return Copyable_Impl::copyByCmpStr(ppRef, id);
-		}
-	public:
-		static const char* GetRefName() {
-			return "WinFW::WindowExStyle_Impl";
-		}
+		// The latest message replaces the held one; wheel deltas add up, clamped to a short.
+		void hold(UINT index, const WindowMessage &msg) {
+			if ((m_heldMask & (1U << index)) == 0) {
+				m_heldMask |= 1U << index;
+				m_held[index] = msg;
+				m_heldCount[index] = 1;
+				enqueue();
+				return;
+			}
 
-		WindowExStyle_Impl() : WindowExStyle_Impl(0) {
+			WPARAM wParam = msg.wParam;
+			if (index == CoalescedWheel || index == CoalescedHWheel) {
+				int delta = static_cast<short>(HIWORD(m_held[index].wParam)) + static_cast<short>(HIWORD(msg.wParam));
+				delta = std::max(-32768, std::min(32767, delta));
+				wParam = static_cast<WPARAM>(static_cast<WORD>(delta)) << 16 | LOWORD(msg.wParam);
+			}
+			m_held[index] = { msg.message, wParam, msg.lParam };
+			++m_heldCount[index];
+			merged.fetch_add(1, std::memory_order_relaxed);
 		}
 
-		WindowExStyle_Impl(DWORD exStyle) : m_exStyle(exStyle) {
+		void deliver(UINT index) {
+			m_heldMask &= ~(1U << index);
+			current = m_heldCount[index];
+			dispatch(m_held[index]);
+			current = 1;
 		}
 
-		const char* getRefName() const {
-			return WindowExStyle::GetRefName();
+		void flush() {
+			for (UINT index = 0; index < NumCoalesced; ++index) {
+				if (m_heldMask & (1U << index)) deliver(index);
+			}
 		}
 
-		virtual DWORD getValue() {
-			return m_exStyle;
-		}
+		// The Window is kept in a window property, so GWLP_USERDATA stays free for the class WNDPROC.
+		static constexpr const wchar_t *propName = L"WinFW::Window";
 
-		WindowExStyle* clear() {
-			m_exStyle = 0;
-			return this;
-		}
+		// Held messages go out once per pump. Inside a modal move / size loop nothing pumps, so they are
+		// delivered as they come; a click or key is preceded by the held cursor move.
+		static LRESULT CALLBACK WndProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam) {
+			Window_Impl *window = static_cast<Window_Impl*>(GetPropW(hWnd, propName));
+			if (window == nullptr) return DefWindowProcW(hWnd, uMsg, wParam, lParam);
 
-		WindowExStyle* AcceptFiles() {
-			m_exStyle |= WS_EX_ACCEPTFILES;
-			return this;
-		}
+			WindowMessage msg{ uMsg, wParam, lParam };
+			if (uMsg == WM_ENTERSIZEMOVE) {
+				window->flush();
+				window->m_sizing = true;
+			}
+			else if (uMsg == WM_EXITSIZEMOVE) window->m_sizing = false;
+			else if (enabled.load(std::memory_order_relaxed) && !window->m_sizing) {
+				int index = coalescedIndex(uMsg);
+				if (index >= 0) {
+					window->hold(index, msg);
+					return 0;
+				}
+			}
+			if ((window->m_heldMask & (1U << CoalescedMouseMove)) != 0 && ((uMsg >= WM_MOUSEFIRST && uMsg <= WM_MOUSELAST) || (uMsg >= WM_KEYFIRST && uMsg <= WM_KEYLAST))) {
+				window->deliver(CoalescedMouseMove);
+			}
 
-		WindowExStyle* AppWindow() {
-			m_exStyle |= WS_EX_APPWINDOW;
-			return this;
-		}
+			if (uMsg != WM_NCDESTROY) return window->dispatch(msg);
 
-		WindowExStyle* ClientEdge() {
-			m_exStyle |= WS_EX_CLIENTEDGE;
-			return this;
+			// A WM_NCDESTROY handler may release the last reference to the Window.
+			window->incRef();
+			LRESULT res = window->dispatch(msg);
+			window->uninstall();
+			window->decRef();
+			return res;
 		}
 
-		WindowExStyle* Composited() {
-			m_exStyle |= WS_EX_COMPOSITED;
-			return this;
+		// Both run on the thread that owns the window.
+		static void installProc(void *ctx) {
+			Window_Impl *window = static_cast<Window_Impl*>(ctx);
+			SetPropW(window->m_hWnd, propName, window);
+			window->m_classProc = reinterpret_cast<WNDPROC>(SetWindowLongPtrW(window->m_hWnd, GWLP_WNDPROC, reinterpret_cast<LONG_PTR>(&WndProc)));
+			window->m_installed = true;
 		}
 
-		WindowExStyle* ContextHelp() {
-			m_exStyle |= WS_EX_CONTEXTHELP;
-			return this;
+		static void uninstallProc(void *ctx) {
+			static_cast<Window_Impl*>(ctx)->uninstall();
 		}
 
-		WindowExStyle* ControlParent() {
-			m_exStyle |= WS_EX_CONTROLPARENT;
-			return this;
+		static void postHandlerProc(void *ctx) {
+			setHandlerProc(ctx);
+			delete static_cast<SetHandlerArgs*>(ctx);
 		}
 
-		WindowExStyle* DLGModalFrame() {
-			m_exStyle |= WS_EX_DLGMODALFRAME;
-			return this;
+		static void destroyProc(void *ctx) {
+			delete static_cast<Window_Impl*>(ctx);
 		}
 
-		WindowExStyle* Layered() {
-			m_exStyle |= WS_EX_LAYERED;
-			return this;
+		static void setHandlerProc(void *ctx) {
+			SetHandlerArgs *args = static_cast<SetHandlerArgs*>(ctx);
+			Window_Impl *window = args->window;
+			try {
+				if (args->message < WM_USER) {
+					if (window->m_handlers.empty()) {
+						if (args->handler.func == nullptr) return;
+						window->m_handlers.assign(WM_USER, Handler{ nullptr, nullptr });
+					}
+					window->m_handlers[args->message] = args->handler;
+				}
+				else if (args->handler.func != nullptr) window->m_userHandlers[args->message] = args->handler;
+				else window->m_userHandlers.erase(args->message);
+			}
+			catch (...) {
+				args->res = false;
+			}
 		}
 
-		WindowExStyle* LayoutRTL() {
-			m_exStyle |= WS_EX_LAYOUTRTL;
-			return this;
+		// On WM_NCDESTROY, or when the Window is released before its window is destroyed.
+		void uninstall() {
+			if (!m_installed) return;
+			Recorder_Impl::removeWindow(m_hWnd);
+			SetWindowLongPtrW(m_hWnd, GWLP_WNDPROC, reinterpret_cast<LONG_PTR>(m_classProc));
+			RemovePropW(m_hWnd, propName);
+			m_installed = false;
+			m_heldMask = 0;
+			dequeue();
 		}
 
-		WindowExStyle* Left() {
-			m_exStyle |= WS_EX_LEFT;
-			return this;
+		// From the app thread while the UI thread runs, these are queued and report TRUE once queued.
+		BOOL showWindow(int nCmdShow) {
+			if (UIThread_Impl::isRemote()) return UIThread_Impl::show(m_hWnd, nCmdShow);
+			return ShowWindow(m_hWnd, nCmdShow);
 		}
 
-		WindowExStyle* LeftScrollBar() {
-			m_exStyle |= WS_EX_LEFTSCROLLBAR;
-			return this;
+		BOOL setWindowPos(int x, int y, int cx, int cy, UINT flags) {
+			if (UIThread_Impl::isRemote()) return UIThread_Impl::setPos(m_hWnd, x, y, cx, cy, flags);
+			return SetWindowPos(m_hWnd, nullptr, x, y, cx, cy, flags);
+		}
+	protected:
+		// From the app thread while the UI thread runs, the Window is uninstalled and deleted on the UI thread,
+		// after every command queued before it, so releasing one does not wait for the UI thread.
+		void destroy() {
+			if (UIThread_Impl::isRemote()) UIThread_Impl::post(&destroyProc, this);
+			else delete this;
+		}
+	public:
+		~Window_Impl() {
+			if (m_installed) UIThread_Impl::call(&uninstallProc, this);
+			m_winClass->decRef();
 		}
 
-		WindowExStyle* LTRReadding() {
-			m_exStyle |= WS_EX_LTRREADING;
-			return this;
+		Window_Impl(HWND hWnd, WinClass *winClass) : m_hWnd(hWnd), m_winClass(winClass), m_classProc(nullptr), m_installed(false), m_held{},
+			m_heldCount{}, m_heldMask(0), m_sizing(false) {
+			Recorder_Impl::addWindow(hWnd);
+			if (hWnd != nullptr) UIThread_Impl::call(&installProc, this);
 		}
 
-		WindowExStyle* MDIChild() {
-			m_exStyle |= WS_EX_MDICHILD;
-			return this;
+		const char* getRefName() const {
+			return Window::GetRefName();
 		}
 
-		WindowExStyle* NoActivate() {
-			m_exStyle |= WS_EX_NOACTIVATE;
-			return this;
+		bool queryRefById(void **const ppRef, unsigned long long id) {
+			return RefTable_Impl<Window_Impl, Window, Ref>::query(this, ppRef, id);
 		}
 
-		WindowExStyle* NoInheriteLayout() {
-			m_exStyle |= WS_EX_NOINHERITLAYOUT;
-			return this;
+		// From the app thread while the UI thread runs, the change is queued and reports true once queued.
+		bool setHandler(UINT message, MessageHandler handler, void *ctx) {
+			if (UIThread_Impl::isRemote()) {
+				try {
+					UIThread_Impl::post(&postHandlerProc, new SetHandlerArgs{ this, message, { handler, ctx }, true });
+				}
+				catch (...) {
+					return false;
+				}
+				return true;
+			}
+
+			SetHandlerArgs args{ this, message, { handler, ctx }, true };
+			setHandlerProc(&args);
+			return args.res;
 		}
 
-		WindowExStyle* NoParentNotify() {
-			m_exStyle |= WS_EX_NOPARENTNOTIFY;
-			return this;
+		bool removeHandler(UINT message) {
+			return setHandler(message, nullptr, nullptr);
 		}
 
-		WindowExStyle* NoRedirectBitmap() {
-			m_exStyle |= WS_EX_NOREDIRECTIONBITMAP;
-			return this;
+		LRESULT callDefault(const WindowMessage &msg) {
+			if (m_classProc == nullptr) return DefWindowProcW(m_hWnd, msg.message, msg.wParam, msg.lParam);
+			return CallWindowProcW(m_classProc, m_hWnd, msg.message, msg.wParam, msg.lParam);
 		}
 
-		WindowExStyle* OverlappedWindow() {
-			m_exStyle |= WS_EX_OVERLAPPEDWINDOW;
-			return this;
+		HWND get() {
+			return m_hWnd;
 		}
 
-		WindowExStyle* PaletteWindow() {
-			m_exStyle |= WS_EX_PALETTEWINDOW;
-			return this;
+		BOOL setTitle(LPCWSTR title) {
+			if (UIThread_Impl::isRemote()) return UIThread_Impl::setTitle(m_hWnd, title);
+			return SetWindowTextW(m_hWnd, title);
 		}
 
-		WindowExStyle* Right() {
-			m_exStyle |= WS_EX_RIGHT;
-			return this;
+		BOOL hide() {
+			return showWindow(SW_HIDE);
 		}
 
-		WindowExStyle* RightScrollBar() {
-			m_exStyle |= WS_EX_RIGHTSCROLLBAR;
-			return this;
+		BOOL show() {
+			return showWindow(SW_SHOW);
 		}
 
-		WindowExStyle* RTLReadding() {
-			m_exStyle |= WS_EX_RTLREADING;
-			return this;
+		BOOL minimize() {
+			return showWindow(SW_MINIMIZE);
 		}
 
-		WindowExStyle* StaticEdge() {
-			m_exStyle |= WS_EX_STATICEDGE;
-			return this;
+		BOOL update() {
+			if (UIThread_Impl::isRemote()) return UIThread_Impl::update(m_hWnd);
+			return UpdateWindow(m_hWnd);
 		}
 
-		WindowExStyle* ToolWindow() {
-			m_exStyle |= WS_EX_TOOLWINDOW;
-			return this;
+		BOOL setPos(int x, int y) {
+			return setWindowPos(x, y, 0, 0, SWP_NOSIZE);
 		}
 
-		WindowExStyle* TopMost() {
-			m_exStyle |= WS_EX_TOPMOST;
-			return this;
+		BOOL setSize(int width, int height) {
+			return setWindowPos(0, 0, width, height, SWP_NOMOVE);
 		}
 
-		WindowExStyle* Transparent() {
-			m_exStyle |= WS_EX_TRANSPARENT;
-			return this;
+		BOOL setClientSize(int width, int height) {
+			RECT r{ 0, 0, width, height };
+			AdjustWindowRectEx(&r, GetWindowLongW(m_hWnd, GWL_STYLE), GetMenu(m_hWnd) == nullptr ? 0 : 1, GetWindowLongW(m_hWnd, GWL_EXSTYLE));
+			width = r.right - r.left;
+			height = r.bottom - r.top;
+			return setWindowPos(0, 0, width, height, SWP_NOMOVE);
 		}
 
-		WindowExStyle* WindowEdge() {
-			m_exStyle |= WS_EX_WINDOWEDGE;
-			return this;
+		BOOL querySize(LPRECT r) const {
+			return GetWindowRect(m_hWnd, r);
 		}
-	};
 
-	class WindowConfig_Impl : public virtual WindowConfig, public virtual Copyable_Impl {
-		DWORD m_dwExStyle;
-		Text::WStringHolder *m_lpWindowName;
-		DWORD m_dwStyle;
-		int m_x;
-		int m_y;
-		HWND m_hWndParent;
-		HMENU m_hMenu;
-		LPVOID m_lpParam;
-		int m_width;
-		int m_height;
-		WinClass *m_winClass;
+		BOOL queryClientSize(LPRECT r) const {
+			return GetClientRect(m_hWnd, r);
+		}
+	};
 
-		bool setInterface(void **const ppRef) {
-			if (ppRef != nullptr) {
-				incRef();
-				*ppRef = static_cast<WindowConfig*>(this);
+	class Keyboard_Impl : public virtual Keyboard, public virtual Ref_Impl, private MessageSink_Impl {
+		KeyboardSource m_source;
+		BYTE m_states[256];
+		KeyMask m_held;
+		KeyMask m_pressed;
+		KeyMask m_released;
+		KeyMask m_live;
+		KeyMask m_livePressed;
+		KeyMask m_liveReleased;
+		KeyTransition m_log[2][MaxTransitions];
+		UINT m_logCount[2];
+		UINT m_logFrame;
+
+		void record(BYTE vKey, bool down, DWORD time) {
+			UINT live = m_logFrame ^ 1;
+			if (m_logCount[live] < MaxTransitions) m_log[live][m_logCount[live]++] = KeyTransition{ vKey, down, time };
+		}
+
+		void keyDown(BYTE vKey, DWORD time) {
+			if (m_live.test(vKey)) return;
+			m_live.bits[vKey >> 6] |= 1ULL << (vKey & 63);
+			m_livePressed.bits[vKey >> 6] |= 1ULL << (vKey & 63);
+			record(vKey, true, time);
+		}
+
+		void keyUp(BYTE vKey, DWORD time) {
+			if (!m_live.test(vKey)) return;
+			m_live.bits[vKey >> 6] &= ~(1ULL << (vKey & 63));
+			m_liveReleased.bits[vKey >> 6] |= 1ULL << (vKey & 63);
+			record(vKey, false, time);
+		}
+
+		void onRawInput(const RAWINPUT &rawInput) {
+			if (rawInput.header.dwType != RIM_TYPEKEYBOARD || rawInput.data.keyboard.VKey >= 256) return;
+			BYTE vKey = static_cast<BYTE>(rawInput.data.keyboard.VKey);
+			if (rawInput.data.keyboard.Flags & RI_KEY_BREAK) keyUp(vKey, 0);
+			else keyDown(vKey, 0);
+		}
+
+		void onMessage(const MSG &msg) {
+			switch (msg.message) {
+			case WM_KEYDOWN:
+			case WM_SYSKEYDOWN:
+				keyDown(static_cast<BYTE>(msg.wParam), msg.time);
+				return;
+			case WM_KEYUP:
+			case WM_SYSKEYUP:
+				keyUp(static_cast<BYTE>(msg.wParam), msg.time);
+				return;
+			case WM_KILLFOCUS:
+				// No key up arrives for keys held while focus moves away.
+				m_live.forEach([&](BYTE vKey) { record(vKey, false, msg.time); });
+				for (UINT word = 0; word < 4; ++word) {
+					m_liveReleased.bits[word] |= m_live.bits[word];
+					m_live.bits[word] = 0;
+				}
+				return;
 			}
-			return true;
 		}
 
-		bool copyInterface(void **const ppRef) {
-			if (ppRef != nullptr) {
-				try {
-					m_winClass->incRef();
-					m_lpWindowName->incRef();
-					*ppRef = static_cast<WindowConfig*>(new WindowConfig_Impl(m_dwExStyle, m_lpWindowName, m_dwStyle, m_x, m_y, m_hWndParent,
-						m_hMenu, m_lpParam, m_width, m_height, m_winClass));
-				}
-				catch (...) {
-					m_lpWindowName->decRef();
-					m_winClass->decRef();
-					return false;
+		BOOL updateFromMessages() {
+			m_held = m_live;
+			m_pressed = m_livePressed;
+			m_released = m_liveReleased;
+			m_livePressed = KeyMask{};
+			m_liveReleased = KeyMask{};
+			m_logFrame ^= 1;
+			m_logCount[m_logFrame ^ 1] = 0;
+			return TRUE;
+		}
+
+		// Gathers bit 7 of every state byte into the held mask.
+		static void packStates(const BYTE *states, KeyMask &mask) {
+#ifdef WINFW_SSE2
+			for (UINT word = 0; word < 4; ++word) {
+				UINT64 value = 0;
+				for (UINT part = 0; part < 4; ++part) {
+					__m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(states + word * 64 + part * 16));
+					value |= static_cast<UINT64>(static_cast<UINT>(_mm_movemask_epi8(bytes))) << (part * 16);
 				}
+				mask.bits[word] = value;
 			}
-			return true;
+#else
+			for (UINT word = 0; word < 4; ++word) {
+				UINT64 value = 0;
+				for (UINT bit = 0; bit < 64; ++bit) value |= static_cast<UINT64>(states[word * 64 + bit] >> 7) << bit;
+				mask.bits[word] = value;
+			}
+#endif
 		}
-	protected:
-		bool queryRefByCmpPtr(void **const ppRef, const char *id) {
-			if (id == WindowConfig::GetRefName()) return setInterface(ppRef);
-			else if (id == WindowConfig_Impl::GetRefName()) {
-				if (ppRef != nullptr) *ppRef = this;
-				return true;
+	public:
+		Keyboard_Impl(KeyboardSource source) : m_source(source), m_states{ 0 }, m_held{}, m_pressed{}, m_released{},
+			m_live{}, m_livePressed{}, m_liveReleased{}, m_logCount{ 0 }, m_logFrame(0) {
+			if (m_source == KeyboardSource::Messages) attach();
+		}
+
+		const char* getRefName() const {
+			return Keyboard::GetRefName();
+		}
+
+		bool queryRefById(void **const ppRef, unsigned long long id) {
+			return RefTable_Impl<Keyboard_Impl, Keyboard, Ref>::query(this, ppRef, id);
+		}
+
+		BOOL update() {
+			if (m_source == KeyboardSource::Messages) return updateFromMessages();
+
+			BOOL res = GetKeyboardState(m_states);
+			if (!res) return res;
+
+			KeyMask prev = m_held;
+			packStates(m_states, m_held);
+			for (UINT word = 0; word < 4; ++word) {
+				m_pressed.bits[word] = m_held.bits[word] & ~prev.bits[word];
+				m_released.bits[word] = prev.bits[word] & ~m_held.bits[word];
 			}
-			else return Copyable_Impl::queryRefByCmpPtr(ppRef, id);
+
+			m_logCount[m_logFrame] = 0;
+			m_released.forEach([&](BYTE vKey) {
+				if (m_logCount[m_logFrame] < MaxTransitions) m_log[m_logFrame][m_logCount[m_logFrame]++] = KeyTransition{ vKey, false, 0 };
+			});
+			m_pressed.forEach([&](BYTE vKey) {
+				if (m_logCount[m_logFrame] < MaxTransitions) m_log[m_logFrame][m_logCount[m_logFrame]++] = KeyTransition{ vKey, true, 0 };
+			});
+			return res;
 		}
 
-		bool queryRefByCmpStr(void **const ppRef, const char *id) {
-			if (std::strcmp(id, WindowConfig::GetRefName()) == 0) return setInterface(ppRef);
-			else return Copyable_Impl::queryRefByCmpStr(ppRef, id);
+		KeyAction getKeyAction(BYTE vKey) {
+			if (m_pressed.test(vKey)) return KeyAction::Press;
+			if (m_released.test(vKey)) return KeyAction::Release;
+			return KeyAction::NoAction;
 		}
 
-		bool copyByCmpPtr(void **const ppRef, const char *id) {
-			if (id == WindowConfig::GetRefName()) return copyInterface(ppRef);
-			else return Copyable_Impl::copyByCmpPtr(ppRef, id);
+		bool isPress(BYTE vKey) {
+			return m_held.test(vKey);
 		}
 
-		bool copyByCmpStr(void **const ppRef, const char *id) {
-			if (std::strcmp(id, WindowConfig::GetRefName()) == 0) return copyInterface(ppRef);
-			else return Copyable_Impl::copyByCmpStr(ppRef, id);
+		bool wasPressed(BYTE vKey) {
+			return m_pressed.test(vKey);
 		}
-	public:
-		static const char* GetRefName() {
-			return "WinFW::WindowConfig_Impl";
+
+		bool wasReleased(BYTE vKey) {
+			return m_released.test(vKey);
 		}
 
-		~WindowConfig_Impl() {
-			m_winClass->decRef();
-			m_lpWindowName->decRef();
+		const KeyMask& getHeld() {
+			return m_held;
 		}
 
-		WindowConfig_Impl(WinClass *winClass, int width, int height) : WindowConfig_Impl(NULL, Text::WStringHolder::New(nullptr),
-			WS_SYSMENU | WS_MINIMIZEBOX | WS_CAPTION, CW_USEDEFAULT, CW_USEDEFAULT, nullptr, nullptr, nullptr, width, height, winClass) {
+		const KeyMask& getPressed() {
+			return m_pressed;
 		}
 
-		WindowConfig_Impl(DWORD dwExStyle, Text::WStringHolder *lpWindowName, DWORD dwStyle, int x, int y, HWND hWndParent, HMENU hMenu,
-			LPVOID lpParam, int width, int height, WinClass *winClass) : m_dwExStyle(dwExStyle), m_lpWindowName(lpWindowName), m_dwStyle(dwStyle), m_x(x), m_y(y),
-			m_hWndParent(hWndParent), m_hMenu(hMenu), m_lpParam(lpParam), m_width(width), m_height(height), m_winClass(winClass) {
+		const KeyMask& getReleased() {
+			return m_released;
 		}
 
-		const char* getRefName() const {
-			return WindowConfig::GetRefName();
+		KeyboardSource getSource() {
+			return m_source;
 		}
 
-		WindowConfig* setX(int x) {
-			m_x = x;
-			return this;
-		} 
+		UINT getTransitionCount() {
+			return m_logCount[m_logFrame];
+		}
 
-		WindowConfig* setY(int y) {
-			m_y = y;
-			return this;
+		const KeyTransition* getTransitions() {
+			return m_log[m_logFrame];
 		}
+	};
 
-		WindowConfig* setWidth(int width) {
-			m_width = width;
-			return this;
+	class Mouse_Impl : public virtual Mouse, public virtual Ref_Impl, private MessageSink_Impl {
+		POINT m_pos;
+		POINT m_mov;
+		POINT m_absolute;
+		bool m_hasAbsolute;
+		MouseButtons m_buttons;
+		POINT m_wheel;
+
+		void press(MouseButton button, bool down) {
+			BYTE bit = static_cast<BYTE>(1 << static_cast<BYTE>(button));
+			if (down) {
+				m_buttons.held |= bit;
+				m_buttons.pressed |= bit;
+			}
+			else {
+				m_buttons.held &= ~bit;
+				m_buttons.released |= bit;
+			}
 		}
 
-		WindowConfig* setHeight(int height) {
-			m_height = height;
-			return this;
+		void onRawInput(const RAWINPUT &rawInput) {
+			if (rawInput.header.dwType == RIM_TYPEMOUSE) processRawMouse(rawInput.data.mouse);
+		}
+	public:
+		Mouse_Impl() : m_pos{}, m_mov{}, m_absolute{}, m_hasAbsolute(false), m_buttons{}, m_wheel{} {
+			attach();
 		}
 
-		WindowConfig* setWinClass(WinClass *&winClass) {
-			m_winClass = winClass;
-			return this;
+		const char* getRefName() const {
+			return Mouse::GetRefName();
 		}
 
-		WindowConfig* setWinClass(WinClass *&&winClass) {
-			WindowConfig *buff = setWinClass(static_cast<WinClass*&>(winClass));
-			winClass->decRef();
-			return buff;
+		bool queryRefById(void **const ppRef, unsigned long long id) {
+			return RefTable_Impl<Mouse_Impl, Mouse, Ref>::query(this, ppRef, id);
 		}
 
-		WindowConfig* setStyle(WindowStyle *&style) {
-			WindowStyle_Impl *buff;
-			if (!style->queryRef(reinterpret_cast<void**>(&buff), WindowStyle_Impl::GetRefName(), true)) throw Exception::InvalidObjectException::New("WindowStyle : incompatible");
-			m_dwStyle = buff->getValue();
-			return this;
+		BOOL updatePos() {
+			return GetCursorPos(&m_pos);
 		}
 
-		WindowConfig* setStyle(WindowStyle *&&style) {
-			WindowConfig *buff = setStyle(static_cast<WindowStyle*&>(style));
-			style->decRef();
-			return buff;
+		POINT getPos() {
+			return m_pos;
 		}
 
-		WindowConfig* setExStyle(WindowExStyle *&exStyle) {
-			WindowExStyle_Impl *buff;
-			if (!exStyle->queryRef(reinterpret_cast<void**>(&buff), WindowExStyle_Impl::GetRefName(), true)) throw Exception::InvalidObjectException::New("WindowExStyle : incompatible");
-			m_dwExStyle = buff->getValue();
-			return this;
+		int getPosX() {
+			return m_pos.x;
 		}
 
-		WindowConfig* setExStyle(WindowExStyle *&&exStyle) {
-			WindowConfig *buff = setExStyle(static_cast<WindowExStyle*&>(exStyle));
-			exStyle->decRef();
+		int getPosY() {
+			return m_pos.y;
+		}
+
+		void updateRawMouseMove(LPARAM lParam) {
+			RAWINPUT rawInput;
+			UINT size = sizeof(rawInput);
+			if (GetRawInputData(reinterpret_cast<HRAWINPUT>(lParam), RID_INPUT, &rawInput, &size, sizeof(RAWINPUTHEADER)) == static_cast<UINT>(-1)) return;
+			if (rawInput.header.dwType == RIM_TYPEMOUSE) processRawMouse(rawInput.data.mouse);
+		}
+
+		// Relative reports add up until passMove. Absolute reports (tablets, remote desktop) are normalized
+		// to 0..65535 over the (virtual) screen and are turned into deltas against the previous report.
+		void processRawMouse(const RAWMOUSE &mouse) {
+			if (mouse.usFlags & MOUSE_MOVE_ABSOLUTE) {
+				bool virtualDesktop = (mouse.usFlags & MOUSE_VIRTUAL_DESKTOP) != 0;
+				POINT pos{
+					static_cast<LONG>(static_cast<INT64>(mouse.lLastX) * GetSystemMetrics(virtualDesktop ? SM_CXVIRTUALSCREEN : SM_CXSCREEN) / 65535),
+					static_cast<LONG>(static_cast<INT64>(mouse.lLastY) * GetSystemMetrics(virtualDesktop ? SM_CYVIRTUALSCREEN : SM_CYSCREEN) / 65535)
+				};
+				if (m_hasAbsolute) {
+					m_mov.x += pos.x - m_absolute.x;
+					m_mov.y += pos.y - m_absolute.y;
+				}
+				m_absolute = pos;
+				m_hasAbsolute = true;
+			}
+			else {
+				m_mov.x += mouse.lLastX;
+				m_mov.y += mouse.lLastY;
+			}
+
+			USHORT flags = mouse.usButtonFlags;
+			if (flags == 0) return;
+			if (flags & RI_MOUSE_LEFT_BUTTON_DOWN) press(MouseButton::Left, true);
+			if (flags & RI_MOUSE_LEFT_BUTTON_UP) press(MouseButton::Left, false);
+			if (flags & RI_MOUSE_RIGHT_BUTTON_DOWN) press(MouseButton::Right, true);
+			if (flags & RI_MOUSE_RIGHT_BUTTON_UP) press(MouseButton::Right, false);
+			if (flags & RI_MOUSE_MIDDLE_BUTTON_DOWN) press(MouseButton::Middle, true);
+			if (flags & RI_MOUSE_MIDDLE_BUTTON_UP) press(MouseButton::Middle, false);
+			if (flags & RI_MOUSE_BUTTON_4_DOWN) press(MouseButton::X1, true);
+			if (flags & RI_MOUSE_BUTTON_4_UP) press(MouseButton::X1, false);
+			if (flags & RI_MOUSE_BUTTON_5_DOWN) press(MouseButton::X2, true);
+			if (flags & RI_MOUSE_BUTTON_5_UP) press(MouseButton::X2, false);
+			if (flags & RI_MOUSE_WHEEL) m_wheel.y += static_cast<SHORT>(mouse.usButtonData);
+			if (flags & RI_MOUSE_HWHEEL) m_wheel.x += static_cast<SHORT>(mouse.usButtonData);
+		}
+
+		POINT passMove() {
+			POINT buff = m_mov;
+			m_mov.x = 0;
+			m_mov.y = 0;
 			return buff;
 		}
 
-		WindowConfig* setParent(HWND hWndParent) {
-			m_hWndParent = hWndParent;
-			return this;
+		MouseButtons passButtons() {
+			MouseButtons buff = m_buttons;
+			m_buttons.pressed = 0;
+			m_buttons.released = 0;
+			return buff;
 		}
 
-		WindowConfig* setMenu(HMENU hMenu) {
-			m_hMenu = hMenu;
-			return this;
+		POINT passWheel() {
+			POINT buff = m_wheel;
+			m_wheel.x = 0;
+			m_wheel.y = 0;
+			return buff;
 		}
 
-		WindowConfig* setLpParam(LPVOID lpParam) {
-			m_lpParam = lpParam;
-			return this;
+		bool isButtonDown(MouseButton button) {
+			return (m_buttons.held & (1 << static_cast<BYTE>(button))) != 0;
 		}
+	};
 
-		WindowConfig* setTitle(LPCWSTR title) {
-			m_lpWindowName->decRef();
-			m_lpWindowName = Text::WStringHolder::New(title);
-			return this;
+	class InputQueue_Impl : public virtual InputQueue, public virtual Ref_Impl, private MessageSink_Impl {
+		InputEvent *m_events;
+		UINT m_mask;
+		std::atomic<UINT> m_head;
+		char m_pad[64];
+		std::atomic<UINT> m_tail;
+		std::atomic<UINT64> m_dropped;
+
+		static UINT roundCapacity(UINT capacity) {
+			UINT res = 2;
+			while (res < capacity && res < (1U << 30)) res <<= 1;
+			return res;
 		}
 
-		virtual int getX() {
-			return m_x;
+		bool push(const InputEvent &event) {
+			UINT tail = m_tail.load(std::memory_order_relaxed);
+			if (tail - m_head.load(std::memory_order_acquire) > m_mask) {
+				m_dropped.fetch_add(1, std::memory_order_relaxed);
+				return false;
+			}
+			m_events[tail & m_mask] = event;
+			m_tail.store(tail + 1, std::memory_order_release);
+			return true;
 		}
 
-		virtual int getY() {
-			return m_y;
+		void onMessage(const MSG &msg) {
+			InputEvent event{};
+			switch (msg.message) {
+			case WM_KEYDOWN:
+			case WM_SYSKEYDOWN:
+				if (msg.lParam & (1 << 30)) return;
+				event.type = InputEventType::Key;
+				event.code = static_cast<BYTE>(msg.wParam);
+				event.down = true;
+				break;
+			case WM_KEYUP:
+			case WM_SYSKEYUP:
+				event.type = InputEventType::Key;
+				event.code = static_cast<BYTE>(msg.wParam);
+				break;
+			case WM_LBUTTONDOWN:
+			case WM_LBUTTONUP:
+				event.type = InputEventType::Button;
+				event.code = static_cast<BYTE>(MouseButton::Left);
+				event.down = msg.message == WM_LBUTTONDOWN;
+				break;
+			case WM_RBUTTONDOWN:
+			case WM_RBUTTONUP:
+				event.type = InputEventType::Button;
+				event.code = static_cast<BYTE>(MouseButton::Right);
+				event.down = msg.message == WM_RBUTTONDOWN;
+				break;
+			case WM_MBUTTONDOWN:
+			case WM_MBUTTONUP:
+				event.type = InputEventType::Button;
+				event.code = static_cast<BYTE>(MouseButton::Middle);
+				event.down = msg.message == WM_MBUTTONDOWN;
+				break;
+			case WM_XBUTTONDOWN:
+			case WM_XBUTTONUP:
+				event.type = InputEventType::Button;
+				event.code = static_cast<BYTE>(GET_XBUTTON_WPARAM(msg.wParam) == XBUTTON1 ? MouseButton::X1 : MouseButton::X2);
+				event.down = msg.message == WM_XBUTTONDOWN;
+				break;
+			case WM_MOUSEMOVE:
+				event.type = InputEventType::Move;
+				event.x = GET_X_LPARAM(msg.lParam);
+				event.y = GET_Y_LPARAM(msg.lParam);
+				break;
+			case WM_MOUSEWHEEL:
+			case WM_MOUSEHWHEEL:
+				event.type = InputEventType::Wheel;
+				if (msg.message == WM_MOUSEWHEEL) event.y = GET_WHEEL_DELTA_WPARAM(msg.wParam);
+				else event.x = GET_WHEEL_DELTA_WPARAM(msg.wParam);
+				break;
+			case WM_INPUT: {
+				RAWINPUT rawInput;
+				UINT size = sizeof(rawInput);
+				if (GetRawInputData(reinterpret_cast<HRAWINPUT>(msg.lParam), RID_INPUT, &rawInput, &size, sizeof(RAWINPUTHEADER)) == static_cast<UINT>(-1)) return;
+				onRawInput(rawInput);
+				return;
+			}
+			default:
+				return;
+			}
+			QueryPerformanceCounter(reinterpret_cast<LARGE_INTEGER*>(&event.time));
+			push(event);
 		}
 
-		virtual int getWidth() {
-			return m_width;
+		void onRawInput(const RAWINPUT &rawInput) {
+			if (rawInput.header.dwType != RIM_TYPEMOUSE) return;
+			if (rawInput.data.mouse.lLastX == 0 && rawInput.data.mouse.lLastY == 0) return;
+			InputEvent event{};
+			event.type = InputEventType::RawMove;
+			event.x = rawInput.data.mouse.lLastX;
+			event.y = rawInput.data.mouse.lLastY;
+			QueryPerformanceCounter(reinterpret_cast<LARGE_INTEGER*>(&event.time));
+			push(event);
+		}
+	public:
+		~InputQueue_Impl() {
+			delete[] m_events;
 		}
 
-		virtual int getHeight() {
-			return m_height;
+		InputQueue_Impl(UINT capacity) : m_events(nullptr), m_mask(roundCapacity(capacity) - 1), m_head(0), m_pad{ 0 }, m_tail(0), m_dropped(0) {
+			m_events = new InputEvent[m_mask + 1];
+			attach();
 		}
 
-		virtual WinClass* getWinClass() {
-			return m_winClass;
+		const char* getRefName() const {
+			return InputQueue::GetRefName();
 		}
 
-		virtual DWORD getStyle() {
-			return m_dwStyle;
+		bool queryRefById(void **const ppRef, unsigned long long id) {
+			return RefTable_Impl<InputQueue_Impl, InputQueue, Ref>::query(this, ppRef, id);
 		}
 
-		virtual DWORD getExStyle() {
-			return m_dwExStyle;
+		bool pop(InputEvent &event) {
+			return drain(&event, 1) == 1;
 		}
 
-		virtual HWND getParent() {
-			return m_hWndParent;
+		UINT drain(InputEvent *events, UINT maxCount) {
+			UINT head = m_head.load(std::memory_order_relaxed);
+			UINT count = m_tail.load(std::memory_order_acquire) - head;
+			if (count > maxCount) count = maxCount;
+			for (UINT i = 0; i < count; ++i) events[i] = m_events[(head + i) & m_mask];
+			m_head.store(head + count, std::memory_order_release);
+			return count;
 		}
 
-		virtual HMENU getMenu() {
-			return m_hMenu;
+		UINT getSize() {
+			return m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire);
 		}
 
-		virtual LPVOID getLpParam() {
-			return m_lpParam;
+		UINT getCapacity() {
+			return m_mask + 1;
 		}
 
-		virtual LPCWSTR getTitle() {
-			return m_lpWindowName->getWString();
+		UINT64 getDropped() {
+			return m_dropped.load(std::memory_order_relaxed);
 		}
 	};
+}
 
-	class Window_Impl : public virtual Window, public virtual Ref_Impl {
-		HWND m_hWnd;
-		WinClass *m_winClass;
+// Jobs
+namespace WinFW {
+	class JobCounter_Impl;
 
-		bool setInterface(void **const ppRef) {
-			if (ppRef != nullptr) {
-				incRef();
-				*ppRef = static_cast<Window*>(this);
-			}
-			return true;
-		}
-	protected:
-		bool queryRefByCmpPtr(void **const ppRef, const char *id) {
-			if (id == Window::GetRefName()) return setInterface(ppRef);
-			else return Ref_Impl::queryRefByCmpPtr(ppRef, id);
-		}
+	struct Job_Impl {
+		JobFunc func;
+		void *ctx;
+		JobCounter_Impl *counter;
+		JobCounter_Impl *dependency;
+	};
 
-		bool queryRefByCmpStr(void **const ppRef, const char *id) {
-			if (std::strcmp(id, Window::GetRefName()) == 0) return setInterface(ppRef);
-			else return Ref_Impl::queryRefByCmpStr(ppRef, id);
-		}
+	// Waiters are queued under m_mutex, and released under it once m_pending drops to 0, so a job is
+	// either released by the last finishing job or sees the counter done and runs right away.
+	class JobCounter_Impl : public virtual JobCounter, public virtual Ref_Impl {
+		std::atomic<LONG> m_pending;
+		std::mutex m_mutex;
+		std::vector<Job_Impl*> m_waiters;
 	public:
-		~Window_Impl() {
-			m_winClass->decRef();
+		static const char* GetRefName() {
+			return "WinFW::JobCounter_Impl";
 		}
 
-		Window_Impl(HWND hWnd, WinClass *winClass) : m_hWnd(hWnd), m_winClass(winClass) {
+		static constexpr unsigned long long RefID = Hidden::RefHash("WinFW::JobCounter_Impl");
+
+		JobCounter_Impl() : m_pending(0) {
 		}
 
 		const char* getRefName() const {
-			return Window::GetRefName();
+			return JobCounter::GetRefName();
 		}
 
-		HWND get() {
-			return m_hWnd;
+		bool queryRefById(void **const ppRef, unsigned long long id) {
+			if (id == RefID) {
+				if (ppRef != nullptr) *ppRef = this;
+				return true;
+			}
+			return RefTable_Impl<JobCounter_Impl, JobCounter, Ref>::query(this, ppRef, id);
 		}
 
-		BOOL setTitle(LPCWSTR title) {
-			return SetWindowTextW(m_hWnd, title);
+		UINT getPending() {
+			return static_cast<UINT>(m_pending.load(std::memory_order_acquire));
 		}
 
-		BOOL hide() {
-			return ShowWindow(m_hWnd, SW_HIDE);
+		bool isDone() {
+			return m_pending.load(std::memory_order_acquire) == 0;
 		}
 
-		BOOL show() {
-			return ShowWindow(m_hWnd, SW_SHOW);
+		void add() {
+			m_pending.fetch_add(1, std::memory_order_relaxed);
 		}
 
-		BOOL minimize() {
-			return ShowWindow(m_hWnd, SW_MINIMIZE);
+		// Returns true when job waits for the counter, false when the counter is already done.
+		bool addWaiter(Job_Impl *job) {
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (isDone()) return false;
+			m_waiters.push_back(job);
+			return true;
 		}
 
-		BOOL update() {
-			return UpdateWindow(m_hWnd);
+		// The job that brings the counter to 0 takes the waiters in the same critical section, so a dependent
+		// queued once the counter is reused waits for the new jobs.
+		void done(std::vector<Job_Impl*> &waiters) {
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (m_pending.fetch_sub(1, std::memory_order_acq_rel) == 1) waiters.swap(m_waiters);
 		}
+	};
 
-		BOOL setPos(int x, int y) {
-			return SetWindowPos(m_hWnd, NULL, x, y, 0, 0, SWP_NOSIZE);
-		}
+	// Chase-Lev deque over a fixed power of two capacity. The owner pushes and pops at the bottom, any
+	// thread steals from the top; the last job is settled by a CAS on top between pop and steal.
+	struct JobDeque_Impl {
+		static constexpr INT64 capacity = 4096;
 
-		BOOL setSize(int width, int height) {
-			return SetWindowPos(m_hWnd, NULL, 0, 0, width, height, SWP_NOMOVE);
+		std::atomic<INT64> top;
+		char pad[64];
+		std::atomic<INT64> bottom;
+		std::atomic<Job_Impl*> jobs[capacity];
+
+		JobDeque_Impl() : top(0), pad{}, bottom(0) {
+			for (std::atomic<Job_Impl*> &job : jobs) job.store(nullptr, std::memory_order_relaxed);
 		}
 
-		BOOL setClientSize(int width, int height) {
-			RECT r{ 0, 0, width, height };
-			AdjustWindowRectEx(&r, GetWindowLongW(m_hWnd, GWL_STYLE), GetMenu(m_hWnd) == nullptr ? 0 : 1, GetWindowLongW(m_hWnd, GWL_EXSTYLE));
-			width = r.right - r.left;
-			height = r.bottom - r.top;
-			return SetWindowPos(m_hWnd, nullptr, 0, 0, width, height, SWP_NOMOVE);
+		bool push(Job_Impl *job) {
+			INT64 bottomIndex = bottom.load(std::memory_order_relaxed);
+			if (bottomIndex - top.load(std::memory_order_acquire) >= capacity) return false;
+			jobs[bottomIndex & (capacity - 1)].store(job, std::memory_order_relaxed);
+			bottom.store(bottomIndex + 1, std::memory_order_release);
+			return true;
 		}
 
-		BOOL querySize(LPRECT r) const {
-			return GetWindowRect(m_hWnd, r);
+		Job_Impl* pop() {
+			INT64 bottomIndex = bottom.load(std::memory_order_relaxed) - 1;
+			bottom.store(bottomIndex, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			INT64 topIndex = top.load(std::memory_order_relaxed);
+
+			if (topIndex > bottomIndex) {
+				bottom.store(bottomIndex + 1, std::memory_order_relaxed);
+				return nullptr;
+			}
+
+			Job_Impl *job = jobs[bottomIndex & (capacity - 1)].load(std::memory_order_relaxed);
+			if (topIndex == bottomIndex) {
+				if (!top.compare_exchange_strong(topIndex, topIndex + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) job = nullptr;
+				bottom.store(bottomIndex + 1, std::memory_order_relaxed);
+			}
+			return job;
 		}
 
-		BOOL queryClientSize(LPRECT r) const {
-			return GetClientRect(m_hWnd, r);
+		// Returns nullptr when empty or when another thread won the race for the top job.
+		Job_Impl* steal() {
+			INT64 topIndex = top.load(std::memory_order_acquire);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			INT64 bottomIndex = bottom.load(std::memory_order_acquire);
+			if (topIndex >= bottomIndex) return nullptr;
+
+			Job_Impl *job = jobs[topIndex & (capacity - 1)].load(std::memory_order_relaxed);
+			if (!top.compare_exchange_strong(topIndex, topIndex + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) return nullptr;
+			return job;
 		}
 	};
 
-	class Keyboard_Impl : public virtual Keyboard, public virtual Ref_Impl {
-		BYTE m_states[256];
-		bool m_lastPress[256];
+	// Idle workers sleep on wake until queued moves past the value they saw before their last look for
+	// work. sleeping is checked by the submitter, so wake is only signalled when someone sleeps.
+	struct JobSystem_Impl {
+		struct Worker {
+			JobDeque_Impl deque;
+			std::atomic<UINT64> jobs;
+			std::atomic<UINT64> steals;
+			std::atomic<INT64> busy;
+			char pad[64];
+
+			Worker() : jobs(0), steals(0), busy(0), pad{} {
+			}
+		};
 
-		bool setInterface(void **const ppRef) {
-			if (ppRef != nullptr) {
-				incRef();
-				*ppRef = static_cast<Keyboard*>(this);
+		static std::atomic<bool> running;
+		static Worker *workers;
+		static UINT numWorkers;
+		static std::vector<std::thread> threads;
+		static thread_local Worker *local;
+		static std::mutex mutex;
+		static std::condition_variable wake;
+		static std::deque<Job_Impl*> shared;
+		static std::atomic<size_t> sharedSize;
+		static std::atomic<UINT64> queued;
+		static std::atomic<UINT> sleeping;
+		static JobCounter_Impl *frame;
+		static INT64 statsStart;
+
+		static void signal() {
+			queued.fetch_add(1, std::memory_order_seq_cst);
+			if (sleeping.load(std::memory_order_seq_cst) != 0) {
+				std::lock_guard<std::mutex> lock(mutex);
+				wake.notify_one();
 			}
-			return true;
 		}
-	protected:
-		bool queryRefByCmpPtr(void **const ppRef, const char *id) {
-			if (id == Keyboard::GetRefName()) return setInterface(ppRef);
-			else return Ref_Impl::queryRefByCmpPtr(ppRef, id);
+
+		static void push(Job_Impl *job) {
+			if (local == nullptr || !local->deque.push(job)) {
+				try {
+					std::lock_guard<std::mutex> lock(mutex);
+					shared.push_back(job);
+					sharedSize.store(shared.size(), std::memory_order_release);
+				}
+				catch (...) {
+					execute(local, job);
+					return;
+				}
+			}
+			signal();
 		}
 
-		bool queryRefByCmpStr(void **const ppRef, const char *id) {
-			if (std::strcmp(id, Keyboard::GetRefName()) == 0) return setInterface(ppRef);
-			else return Ref_Impl::queryRefByCmpStr(ppRef, id);
+		static Job_Impl* take(Worker *self) {
+			Job_Impl *job = self != nullptr ? self->deque.pop() : nullptr;
+			if (job != nullptr) return job;
+
+			if (sharedSize.load(std::memory_order_acquire) != 0) {
+				std::lock_guard<std::mutex> lock(mutex);
+				if (!shared.empty()) {
+					job = shared.front();
+					shared.pop_front();
+					sharedSize.store(shared.size(), std::memory_order_release);
+					return job;
+				}
+			}
+
+			UINT first = self != nullptr ? static_cast<UINT>(self - workers) + 1 : 0;
+			for (UINT i = 0; i < numWorkers; ++i) {
+				Worker &victim = workers[(first + i) % numWorkers];
+				if (&victim == self) continue;
+				job = victim.deque.steal();
+				if (job != nullptr) {
+					if (self != nullptr) count(self->steals, 1);
+					return job;
+				}
+			}
+			return nullptr;
 		}
-	public:
-		Keyboard_Impl() : m_states{ 0 }, m_lastPress{ false } {
+
+		// Only the owning worker writes its counters.
+		static void count(std::atomic<UINT64> &counter, UINT64 value) {
+			counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
 		}
 
-		const char* getRefName() const {
-			return Keyboard::GetRefName();
+		// Drops the job's references and releases the jobs that waited for its counter.
+		static void retire(Job_Impl *job) {
+			JobCounter_Impl *counter = job->counter;
+			if (job->dependency != nullptr) job->dependency->decRef();
+			job->~Job_Impl();
+			Pool_Impl::release(job, sizeof(Job_Impl));
+
+			if (counter == nullptr) return;
+			std::vector<Job_Impl*> waiters;
+			counter->done(waiters);
+			for (Job_Impl *waiter : waiters) push(waiter);
+			counter->decRef();
 		}
 
-		BOOL update() {
-			return GetKeyboardState(m_states);
+		static void execute(Worker *self, Job_Impl *job) {
+			if (self == nullptr) {
+				job->func(job->ctx);
+				retire(job);
+				return;
+			}
+
+			INT64 begin, end;
+			QueryPerformanceCounter(reinterpret_cast<LARGE_INTEGER*>(&begin));
+			job->func(job->ctx);
+			retire(job);
+			QueryPerformanceCounter(reinterpret_cast<LARGE_INTEGER*>(&end));
+			count(self->jobs, 1);
+			self->busy.store(self->busy.load(std::memory_order_relaxed) + end - begin, std::memory_order_relaxed);
 		}
 
-		KeyAction getKeyAction(BYTE vKey) {
-			if (m_states[vKey] & (1 << 7)) {
-				if (!m_lastPress[vKey]) {
-					m_lastPress[vKey] = true;
-					return KeyAction::Press;
-				}
+		static bool submit(JobFunc func, void *ctx, JobCounter_Impl *counter, JobCounter_Impl *dependency) {
+			Job_Impl *job;
+			try {
+				job = new (Pool_Impl::allocate(sizeof(Job_Impl))) Job_Impl{ func, ctx, counter, dependency };
 			}
-			else {
-				if (m_lastPress[vKey]) {
-					m_lastPress[vKey] = false;
-					return KeyAction::Release;
+			catch (...) {
+				return false;
+			}
+
+			if (counter != nullptr) {
+				counter->incRef();
+				counter->add();
+			}
+			if (dependency != nullptr) {
+				dependency->incRef();
+				try {
+					if (dependency->addWaiter(job)) return true;
+				}
+				catch (...) {
+					retire(job);
+					return false;
 				}
 			}
-			return KeyAction::NoAction;
+			push(job);
+			return true;
 		}
 
-		bool isPress(BYTE vKey) {
-			return m_states[vKey] == (1 << 7);
+		static void wait(JobCounter_Impl *counter) {
+			while (!counter->isDone()) {
+				Job_Impl *job = take(local);
+				if (job != nullptr) execute(local, job);
+				else std::this_thread::yield();
+			}
 		}
-	};
 
-	class Mouse_Impl : public virtual Mouse, public virtual Ref_Impl {
-		POINT m_pos;
-		POINT m_mov;
-		BYTE m_pData[40];
-		UINT m_pcbSize;
+		static void waitFrame() {
+			wait(frame);
+		}
 
-		bool setInterface(void **const ppRef) {
-			if (ppRef != nullptr) {
-				incRef();
-				*ppRef = static_cast<Mouse*>(this);
+		static void run(Worker *self) {
+			local = self;
+			while (running.load(std::memory_order_acquire)) {
+				Job_Impl *job = take(self);
+				if (job != nullptr) {
+					execute(self, job);
+					continue;
+				}
+
+				UINT64 seen = queued.load(std::memory_order_seq_cst);
+				job = take(self);
+				if (job != nullptr) {
+					execute(self, job);
+					continue;
+				}
+
+				sleeping.fetch_add(1, std::memory_order_seq_cst);
+				{
+					std::unique_lock<std::mutex> lock(mutex);
+					while (queued.load(std::memory_order_seq_cst) == seen && running.load(std::memory_order_acquire)) wake.wait(lock);
+				}
+				sleeping.fetch_sub(1, std::memory_order_seq_cst);
 			}
-			return true;
 		}
-	protected:
-		bool queryRefByCmpPtr(void **const ppRef, const char *id) {
-			if (id == Mouse::GetRefName()) return setInterface(ppRef);
-			else return Ref_Impl::queryRefByCmpPtr(ppRef, id);
+	};
+
+	std::atomic<bool> JobSystem_Impl::running(false);
+	JobSystem_Impl::Worker *JobSystem_Impl::workers = nullptr;
+	UINT JobSystem_Impl::numWorkers = 0;
+	std::vector<std::thread> JobSystem_Impl::threads;
+	thread_local JobSystem_Impl::Worker *JobSystem_Impl::local = nullptr;
+	std::mutex JobSystem_Impl::mutex;
+	std::condition_variable JobSystem_Impl::wake;
+	std::deque<Job_Impl*> JobSystem_Impl::shared;
+	std::atomic<size_t> JobSystem_Impl::sharedSize(0);
+	std::atomic<UINT64> JobSystem_Impl::queued(0);
+	std::atomic<UINT> JobSystem_Impl::sleeping(0);
+	JobCounter_Impl *JobSystem_Impl::frame = nullptr;
+	INT64 JobSystem_Impl::statsStart = 0;
+
+	// count = 0 : one worker per hardware thread besides the caller.
+	bool JobSystem::start(UINT count) {
+		if (JobSystem_Impl::running.load(std::memory_order_acquire)) return false;
+		if (count == 0) {
+			UINT hardware = std::thread::hardware_concurrency();
+			count = hardware > 1 ? hardware - 1 : 1;
 		}
 
-		bool queryRefByCmpStr(void **const ppRef, const char *id) {
-			if (std::strcmp(id, Mouse::GetRefName()) == 0) return setInterface(ppRef);
-			else return Ref_Impl::queryRefByCmpStr(ppRef, id);
+		try {
+			JobSystem_Impl::frame = new JobCounter_Impl();
+			JobSystem_Impl::workers = new JobSystem_Impl::Worker[count + 1];
 		}
-	public:
-		Mouse_Impl() : m_pos{ 0 }, m_mov{ 0 }, m_pData{ 0 }, m_pcbSize(sizeof(m_pData) / sizeof(BYTE)) {
+		catch (...) {
+			if (JobSystem_Impl::frame != nullptr) JobSystem_Impl::frame->decRef();
+			JobSystem_Impl::frame = nullptr;
+			return false;
 		}
+		JobSystem_Impl::numWorkers = count + 1;
+		JobSystem_Impl::local = &JobSystem_Impl::workers[0];
+		JobSystem_Impl::running.store(true, std::memory_order_release);
 
-		const char* getRefName() const {
-			return Mouse::GetRefName();
+		try {
+			for (UINT i = 1; i <= count; ++i) JobSystem_Impl::threads.emplace_back(&JobSystem_Impl::run, &JobSystem_Impl::workers[i]);
 		}
-
-		BOOL updatePos() {
-			return GetCursorPos(&m_pos);
+		catch (...) {
+			stop();
+			return false;
 		}
 
-		POINT getPos() {
-			return m_pos;
-		}
+		resetStats();
+		EventLoop_Impl::frameBarrier = &JobSystem_Impl::waitFrame;
+		return true;
+	}
 
-		int getPosX() {
-			return m_pos.x;
-		}
+	// Joins the workers, then runs whatever is still queued on the calling thread.
+	void JobSystem::stop() {
+		if (!JobSystem_Impl::running.load(std::memory_order_acquire)) return;
+
+		EventLoop_Impl::frameBarrier = nullptr;
+		JobSystem_Impl::running.store(false, std::memory_order_release);
+		{
+			std::lock_guard<std::mutex> lock(JobSystem_Impl::mutex);
+			JobSystem_Impl::wake.notify_all();
+		}
+		for (std::thread &thread : JobSystem_Impl::threads) thread.join();
+		JobSystem_Impl::threads.clear();
+
+		JobSystem_Impl::local = &JobSystem_Impl::workers[0];
+		Job_Impl *job;
+		while ((job = JobSystem_Impl::take(JobSystem_Impl::local)) != nullptr) JobSystem_Impl::execute(JobSystem_Impl::local, job);
+
+		JobSystem_Impl::local = nullptr;
+		delete[] JobSystem_Impl::workers;
+		JobSystem_Impl::workers = nullptr;
+		JobSystem_Impl::numWorkers = 0;
+		JobSystem_Impl::frame->decRef();
+		JobSystem_Impl::frame = nullptr;
+	}
 
-		int getPosY() {
-			return m_pos.y;
+	bool JobSystem::isRunning() {
+		return JobSystem_Impl::running.load(std::memory_order_acquire);
+	}
+
+	UINT JobSystem::getWorkerCount() {
+		return JobSystem_Impl::numWorkers;
+	}
+
+	bool JobSystem::run(JobFunc func, void *ctx, JobCounter *counter, JobCounter *dependency) {
+		if (!JobSystem_Impl::running.load(std::memory_order_acquire)) {
+			func(ctx);
+			return true;
 		}
 
-		void updateRawMouseMove(LPARAM lParam) {
-			GetRawInputData((HRAWINPUT)lParam, RID_INPUT, m_pData, &m_pcbSize, sizeof(RAWINPUTHEADER));
-			RAWINPUT* rawInput = (RAWINPUT*)m_pData;
+		JobCounter_Impl *counterImpl = nullptr;
+		JobCounter_Impl *dependencyImpl = nullptr;
+		if (counter != nullptr && !counter->queryRefById(reinterpret_cast<void**>(&counterImpl), JobCounter_Impl::RefID)) return false;
+		if (dependency != nullptr && !dependency->queryRefById(reinterpret_cast<void**>(&dependencyImpl), JobCounter_Impl::RefID)) return false;
+		return JobSystem_Impl::submit(func, ctx, counterImpl, dependencyImpl);
+	}
 
-			if (rawInput->header.dwType == RIM_TYPEMOUSE) {
-				m_mov.x = rawInput->data.mouse.lLastX;
-				m_mov.y = rawInput->data.mouse.lLastY;
-			}
+	bool JobSystem::runFrame(JobFunc func, void *ctx, JobCounter *dependency) {
+		if (!JobSystem_Impl::running.load(std::memory_order_acquire)) {
+			func(ctx);
+			return true;
 		}
 
-		POINT passMove() {
-			POINT buff = m_mov;
-			m_mov.x = 0;
-			m_mov.y = 0;
-			return buff;
+		JobCounter_Impl *dependencyImpl = nullptr;
+		if (dependency != nullptr && !dependency->queryRefById(reinterpret_cast<void**>(&dependencyImpl), JobCounter_Impl::RefID)) return false;
+		return JobSystem_Impl::submit(func, ctx, JobSystem_Impl::frame, dependencyImpl);
+	}
+
+	void JobSystem::wait(JobCounter *counter) {
+		JobCounter_Impl *counterImpl;
+		if (counter == nullptr || !counter->queryRefById(reinterpret_cast<void**>(&counterImpl), JobCounter_Impl::RefID)) return;
+		JobSystem_Impl::wait(counterImpl);
+	}
+
+	void JobSystem::waitFrame() {
+		if (JobSystem_Impl::running.load(std::memory_order_acquire)) JobSystem_Impl::waitFrame();
+	}
+
+	WorkerStats JobSystem::getWorkerStats(UINT index) {
+		WorkerStats res{};
+		if (index >= JobSystem_Impl::numWorkers) return res;
+
+		INT64 cps, now;
+		QueryPerformanceFrequency(reinterpret_cast<LARGE_INTEGER*>(&cps));
+		QueryPerformanceCounter(reinterpret_cast<LARGE_INTEGER*>(&now));
+		JobSystem_Impl::Worker &worker = JobSystem_Impl::workers[index];
+		res.jobs = worker.jobs.load(std::memory_order_relaxed);
+		res.steals = worker.steals.load(std::memory_order_relaxed);
+		INT64 busy = worker.busy.load(std::memory_order_relaxed);
+		res.busyTime = static_cast<double>(busy) / cps;
+		if (now > JobSystem_Impl::statsStart) res.utilization = static_cast<double>(busy) / (now - JobSystem_Impl::statsStart);
+		return res;
+	}
+
+	void JobSystem::resetStats() {
+		for (UINT i = 0; i < JobSystem_Impl::numWorkers; ++i) {
+			JobSystem_Impl::workers[i].jobs.store(0, std::memory_order_relaxed);
+			JobSystem_Impl::workers[i].steals.store(0, std::memory_order_relaxed);
+			JobSystem_Impl::workers[i].busy.store(0, std::memory_order_relaxed);
 		}
-	};
+		QueryPerformanceCounter(reinterpret_cast<LARGE_INTEGER*>(&JobSystem_Impl::statsStart));
+	}
 }
 
 // Interface : New
@@ -1644,16 +5126,7 @@ namespace WinFW {
 	namespace Text {
 		StringHolder* StringHolder::New(const char *str) {
 			try {
-				if (str == nullptr) {
-					return new StringHolder_Impl(nullptr, 0);
-				}
-				else {
-					size_t count = std::strlen(str);
-					size_t countBuff = count + 1;
-					char *buff = new char[countBuff];
-					std::memcpy(buff, str, countBuff * sizeof(char));
-					return new StringHolder_Impl(buff, count);
-				}
+				return StringHolder_Impl::Create(str, str == nullptr ? 0 : std::strlen(str));
 			}
 			catch (...) {
 				return nullptr;
@@ -1662,13 +5135,25 @@ namespace WinFW {
 		
 		StringHolder* StringHolder::New(const char *str, size_t count) {
 			try {
-				if (str == nullptr) return new StringHolder_Impl(nullptr, 0);
-				else {
-					size_t countBuff = count + 1;
-					char *buff = new char[countBuff];
-					std::memcpy(buff, str, countBuff * sizeof(char));
-					return new StringHolder_Impl(buff, count);
-				}
+				return StringHolder_Impl::Create(str, count);
+			}
+			catch (...) {
+				return nullptr;
+			}
+		}
+
+		StringHolder* StringHolder::NewStatic(const char *str, size_t count) {
+			try {
+				return StringHolder_Impl::CreateExternal(const_cast<char*>(str), count, nullptr);
+			}
+			catch (...) {
+				return nullptr;
+			}
+		}
+
+		StringHolder* StringHolder::Adopt(char *str, size_t count, Deleter deleter) {
+			try {
+				return StringHolder_Impl::CreateExternal(str, count, deleter);
 			}
 			catch (...) {
 				return nullptr;
@@ -1677,14 +5162,7 @@ namespace WinFW {
 		
 		WStringHolder* WStringHolder::New(const wchar_t *str) {
 			try {
-				if (str == nullptr) return new WStringHolder_Impl(nullptr, 0);
-				else {
-					size_t count = std::wcslen(str);
-					size_t countBuff = count + 1;
-					wchar_t *buff = new wchar_t[countBuff];
-					std::memcpy(buff, str, countBuff * sizeof(wchar_t));
-					return new WStringHolder_Impl(buff, count);
-				}
+				return WStringHolder_Impl::Create(str, str == nullptr ? 0 : std::wcslen(str));
 			}
 			catch (...) {
 				return nullptr;
@@ -1693,15 +5171,43 @@ namespace WinFW {
 		
 		WStringHolder* WStringHolder::New(const wchar_t *str, size_t count) {
 			try {
-				if (str == nullptr) {
-					return new WStringHolder_Impl(nullptr, 0);
-				}
-				else {
-					size_t countBuff = count + 1;
-					wchar_t *buff = new wchar_t[countBuff];
-					std::memcpy(buff, str, countBuff * sizeof(wchar_t));
-					return new WStringHolder_Impl(buff, count);
-				}
+				return WStringHolder_Impl::Create(str, count);
+			}
+			catch (...) {
+				return nullptr;
+			}
+		}
+
+		WStringHolder* WStringHolder::NewStatic(const wchar_t *str, size_t count) {
+			try {
+				return WStringHolder_Impl::CreateExternal(const_cast<wchar_t*>(str), count, nullptr);
+			}
+			catch (...) {
+				return nullptr;
+			}
+		}
+
+		WStringHolder* WStringHolder::Adopt(wchar_t *str, size_t count, Deleter deleter) {
+			try {
+				return WStringHolder_Impl::CreateExternal(str, count, deleter);
+			}
+			catch (...) {
+				return nullptr;
+			}
+		}
+
+		WStringHolder* WStringHolder::Intern(const wchar_t *str) {
+			try {
+				return WStringHolder_Impl::Intern(str, str == nullptr ? 0 : std::wcslen(str));
+			}
+			catch (...) {
+				return nullptr;
+			}
+		}
+
+		WStringHolder* WStringHolder::Intern(const wchar_t *str, size_t count) {
+			try {
+				return WStringHolder_Impl::Intern(str, count);
 			}
 			catch (...) {
 				return nullptr;
@@ -1729,20 +5235,20 @@ namespace WinFW {
 		}
 	}
 
-	WinClassStyle* WinClassStyle::New() {
+	WinClassStyle* WinClassStyle::New(RefPolicy policy) {
 		try {
-			return new WinClassStyle_Impl();
+			return new WinClassStyle_Impl(policy);
 		}
 		catch (...) {
 			return nullptr;
 		}
 	}
 
-	WinClassConfig* WinClassConfig::New(LPCWSTR lpszClassName, WNDPROC lpfnWndProc) {
+	WinClassConfig* WinClassConfig::New(LPCWSTR lpszClassName, WNDPROC lpfnWndProc, RefPolicy policy) {
 		try {
-			Text::WStringHolder *str = Text::WStringHolder::New(lpszClassName);
+			Text::WStringHolder *str = Text::WStringHolder::Intern(lpszClassName);
 			try {
-				return new WinClassConfig_Impl(str, lpfnWndProc);
+				return new WinClassConfig_Impl(str, lpfnWndProc, policy);
 			}
 			catch (...) {
 				str->decRef();
@@ -1757,13 +5263,13 @@ namespace WinFW {
 	WinClass* WinClass::New(WinClassConfig *&winclassConfig) {
 		try {
 			WinClassConfig_Impl *buff;
-			if(!winclassConfig->queryRef(reinterpret_cast<void**>(&buff), WinClassConfig_Impl::GetRefName(), false)) throw Exception::InvalidObjectException::New("WinClassConfig : incompatible");
+			if(!winclassConfig->queryRefById(reinterpret_cast<void**>(&buff), WinClassConfig_Impl::RefID)) throw Exception::InvalidObjectException::New("WinClassConfig : incompatible");
 
 			WNDCLASSEXW wcex;
 			wcex.cbSize = sizeof(WNDCLASSEXW);
 			wcex.hInstance = g_hInstance;
 			wcex.lpszClassName = buff->getClassName();
-			wcex.lpfnWndProc = buff->getWndProc();
+			wcex.lpfnWndProc = buff->getWndProc() != nullptr ? buff->getWndProc() : &DefWindowProcW;
 			wcex.cbClsExtra = buff->getClsExtraBytes();
 			wcex.cbWndExtra = buff->getWndExtraBytes();
 			wcex.hbrBackground = buff->getBackgroundColor();
@@ -1774,7 +5280,8 @@ namespace WinFW {
 			wcex.style = buff->getStyle();
 			RegisterClassExW(&wcex);
 
-			Text::WStringHolder *str = Text::WStringHolder::New(wcex.lpszClassName);
+			Text::WStringHolder *str = buff->getClassNameHolder();
+			str->incRef();
 
 			try {
 				return new WinClass_Impl(str);
@@ -1803,33 +5310,33 @@ namespace WinFW {
 		}
 	}
 
-	WindowStyle* WindowStyle::New() {
+	WindowStyle* WindowStyle::New(RefPolicy policy) {
 		try {
-			return new WindowStyle_Impl();
+			return new WindowStyle_Impl(policy);
 		}
 		catch (...) {
 			return nullptr;
 		}
 	}
 
-	WindowExStyle* WindowExStyle::New() {
+	WindowExStyle* WindowExStyle::New(RefPolicy policy) {
 		try {
-			return new WindowExStyle_Impl();
+			return new WindowExStyle_Impl(policy);
 		}
 		catch (...) {
 			return nullptr;
 		}
 	}
 
-	WindowConfig* WindowConfig::New(WinClass *&winClass, int width, int height) {
+	WindowConfig* WindowConfig::New(WinClass *&winClass, int width, int height, RefPolicy policy) {
 		try {
 			try {
 				winClass->incRef();
 			}
 			catch (...) {
-				return false;
+				return nullptr;
 			}
-			return new WindowConfig_Impl(winClass, width, height);
+			return new WindowConfig_Impl(winClass, width, height, policy);
 		}
 		catch (...) {
 			winClass->decRef();
@@ -1837,9 +5344,9 @@ namespace WinFW {
 		}
 	}
 
-	WindowConfig* WindowConfig::New(WinClass *&&winClass, int width, int height) {
+	WindowConfig* WindowConfig::New(WinClass *&&winClass, int width, int height, RefPolicy policy) {
 		try {
-			WindowConfig *buff = New(static_cast<WinClass*&>(winClass), width, height);
+			WindowConfig *buff = New(static_cast<WinClass*&>(winClass), width, height, policy);
 			winClass->decRef();
 			return buff;
 		}
@@ -1852,7 +5359,7 @@ namespace WinFW {
 		WinClass *winClass = nullptr;
 		try {
 			WindowConfig_Impl *buff;
-			if (!windowConfig->queryRef(reinterpret_cast<void**>(&buff), WindowConfig_Impl::GetRefName(), false)) throw Exception::InvalidObjectException::New("WindowConfig : incompatible");
+			if (!windowConfig->queryRefById(reinterpret_cast<void**>(&buff), WindowConfig_Impl::RefID)) throw Exception::InvalidObjectException::New("WindowConfig : incompatible");
 
 			winClass = buff->getWinClass();
 
@@ -1875,10 +5382,10 @@ namespace WinFW {
 				height = buff->getHeight();
 			}
 
-			return new Window_Impl(CreateWindowExW(
+			return new Window_Impl(UIThread_Impl::createWindow(
 				buff->getExStyle(), winClass->getName(), buff->getTitle(), buff->getStyle(),
 				buff->getX(), buff->getY(), width, height,
-				buff->getParent(), buff->getMenu(), g_hInstance, buff->getLpParam()),
+				buff->getParent(), buff->getMenu(), buff->getLpParam()),
 				winClass);
 		}
 		catch (Exception::Exception *e) {
@@ -1901,9 +5408,9 @@ namespace WinFW {
 		}
 	}
 
-	Keyboard* Keyboard::New() {
+	Keyboard* Keyboard::New(KeyboardSource source) {
 		try {
-			return new Keyboard_Impl();
+			return new Keyboard_Impl(source);
 		}
 		catch (...) {
 			return nullptr;
@@ -1918,4 +5425,22 @@ namespace WinFW {
 			return nullptr;
 		}
 	}
-}
\ No newline at end of file
+
+	InputQueue* InputQueue::New(UINT capacity) {
+		try {
+			return new InputQueue_Impl(capacity);
+		}
+		catch (...) {
+			return nullptr;
+		}
+	}
+
+	JobCounter* JobCounter::New() {
+		try {
+			return new JobCounter_Impl();
+		}
+		catch (...) {
+			return nullptr;
+		}
+	}
+}
\ No newline at end of file
@@ -1,22 +1,44 @@
 #pragma once
 
-#if !defined(_WIN32) && !defined(_WIN64)
-#error This header only available on Windows Platform
+#if !defined(_WIN32) && !defined(_WIN64) && !defined(WINFW_HEADLESS)
+#error This header only available on Windows Platform (define WINFW_HEADLESS for the headless backend)
 #endif
 
-#if !defined(UNICODE) && !defined( _UNICODE)
+#if !defined(UNICODE) && !defined( _UNICODE) && !defined(WINFW_HEADLESS)
 #error Please use Unicode Character Set
 #endif
 
 #pragma push_macro("WIN32_LEAN_AND_MEAN")
 #pragma push_macro("DLL_DECLSPEC")
 
+#include <cassert>
 #include <type_traits>
 
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#if __has_include(<coroutine>)
+#include <coroutine>
+#include <exception>
+#include <new>
+#define WINFW_COROUTINES
+#endif
+#endif
+
+#ifdef WINFW_HEADLESS
+#include "WinFW_Headless.hpp"
+#else
 #define WIN32_LEAN_AND_MEAN
 #include <Windows.h>
+#endif
 
-#ifdef WINFW_DEV_MODE
+#if defined(WINFW_HEADLESS) && defined(__GNUC__)
+#define DLL_DECLSPEC __attribute__((visibility("default")))
+#elif defined(WINFW_HEADLESS)
+#define DLL_DECLSPEC
+#elif defined(WINFW_DEV_MODE)
 #define DLL_DECLSPEC __declspec(dllexport)
 #else
 #define DLL_DECLSPEC __declspec(dllimport)
@@ -24,9 +46,46 @@
 
 namespace WinFW {
 	DLL_DECLSPEC void init(HINSTANCE);
+
+	namespace Hidden {
+		// FNV-1a over the interface name, the same in every module so IDs compare across DLL boundaries.
+		constexpr unsigned long long RefHash(const char *name) {
+			unsigned long long hash = 14695981039346656037ULL;
+			while (*name != '\0') {
+				hash ^= static_cast<unsigned char>(*name++);
+				hash *= 1099511628211ULL;
+			}
+			return hash;
+		}
+
+		// Index of the lowest set bit, value must not be 0.
+		inline unsigned int LowestBit(unsigned long long value) {
+#if defined(_MSC_VER) && defined(_M_IX86)
+			unsigned long index;
+			if (_BitScanForward(&index, static_cast<unsigned long>(value))) return index;
+			_BitScanForward(&index, static_cast<unsigned long>(value >> 32));
+			return index + 32;
+#elif defined(_MSC_VER)
+			unsigned long index;
+			_BitScanForward64(&index, value);
+			return index;
+#else
+			return static_cast<unsigned int>(__builtin_ctzll(value));
+#endif
+		}
+	}
+	
+	// Atomic counts may be shared between threads. Confined counts are plain increments and must stay on
+	// the creating thread (checked by assert in debug builds). The policy belongs to the object and is
+	// picked at runtime by incRef / decRef.
+	enum class RefPolicy {
+		Atomic,
+		Confined
+	};
 	
 	class Ref {
 	public:
+		static constexpr unsigned long long RefID = Hidden::RefHash("WinFW::Ref");
 		DLL_DECLSPEC static const char* GetRefName();
 
 		virtual unsigned long long numRef() = 0;
@@ -35,13 +94,17 @@ namespace WinFW {
 		virtual bool delRef() = 0;
 		virtual bool queryRef(void**const, const char*, bool = false) = 0;
 		virtual const char* getRefName() = 0;
+		virtual bool queryRefById(void**const, unsigned long long) = 0;
+		virtual RefPolicy getRefPolicy() = 0;
 	};
 
 	class Copyable : public virtual Ref {
 	public:
+		static constexpr unsigned long long RefID = Hidden::RefHash("WinFW::Copyable");
 		DLL_DECLSPEC static const char* GetRefName();
 
 		virtual bool copy(void**const, const char*, bool = false) = 0;
+		virtual bool copyById(void**const, unsigned long long) = 0;
 	};
 
 	namespace Hidden {
@@ -54,8 +117,8 @@ namespace WinFW {
 		template<bool, typename True, typename>
 		class If : public Evalable<True> {};
 
-		template<typename False>
-		class If<false, typename, False> : public Evalable<False> {};
+		template<typename True, typename False>
+		class If<false, True, False> : public Evalable<False> {};
 		  
 		namespace IPtr {
 			template<typename Interface>
@@ -106,12 +169,12 @@ namespace WinFW {
 				}
 
 				template<typename TargetType>
-				inline bool queryRef(TargetType **target, bool cmpByStr = false) {
+				inline bool queryRef(TargetType **target, bool = false) {
 					if (*target != nullptr) {
 						(*target)->decRef();
 						*target = nullptr;
 					}
-					return m_ptr->queryRef(reinterpret_cast<void**>(target), TargetType::GetRefName(), cmpByStr);
+					return m_ptr->queryRefById(reinterpret_cast<void**>(target), TargetType::RefID);
 				}
 			};
 
@@ -123,12 +186,12 @@ namespace WinFW {
 				}
 
 				template<typename TargetType>
-				inline bool copy(TargetType **target, bool cmpByStr = false) {
+				inline bool copy(TargetType **target, bool = false) {
 					if (*target != nullptr) {
 						(*target)->decRef();
 						*target = nullptr;
 					}
-					return Base::m_ptr->copy(reinterpret_cast<void**>(target), TargetType::GetRefName(), cmpByStr);
+					return Base::m_ptr->copyById(reinterpret_cast<void**>(target), TargetType::RefID);
 				}
 			};
 		}
@@ -173,7 +236,7 @@ namespace WinFW {
 		template<typename SomeInterface>
 		inline IPtr(IPtr<SomeInterface> &&rhs) : IPtr(static_cast<Interface*&&>(rhs.m_ptr)) {}
 
-		inline IPtr& operator=(decltype(__nullptr)) {
+		inline IPtr& operator=(decltype(nullptr)) {
 			Base::decRef();
 			return *this;
 		}
@@ -238,22 +301,36 @@ namespace WinFW {
 	namespace Text {
 		class StringHolder : public virtual Copyable {
 		public:
+			static constexpr unsigned long long RefID = Hidden::RefHash("WinFW::Text::StringHolder");
 			DLL_DECLSPEC static const char* GetRefName();
 			DLL_DECLSPEC static StringHolder* New(const char*);
 			DLL_DECLSPEC static StringHolder* New(const char*, size_t);
 
+			typedef void (*Deleter)(char*);
+			DLL_DECLSPEC static StringHolder* NewStatic(const char*, size_t);
+			DLL_DECLSPEC static StringHolder* Adopt(char*, size_t, Deleter);
+
 			virtual size_t getSize() = 0;
-			virtual char* getString() = 0;
+			virtual const char* getString() = 0;
 		};
 
 		class WStringHolder : public virtual Copyable {
 		public:
+			static constexpr unsigned long long RefID = Hidden::RefHash("WinFW::Text::WStringHolder");
 			DLL_DECLSPEC static const char* GetRefName();
 			DLL_DECLSPEC static WStringHolder* New(const wchar_t*);
 			DLL_DECLSPEC static WStringHolder* New(const wchar_t*, size_t);
 
+			typedef void (*Deleter)(wchar_t*);
+			DLL_DECLSPEC static WStringHolder* NewStatic(const wchar_t*, size_t);
+			DLL_DECLSPEC static WStringHolder* Adopt(wchar_t*, size_t, Deleter);
+			DLL_DECLSPEC static WStringHolder* Intern(const wchar_t*);
+			DLL_DECLSPEC static WStringHolder* Intern(const wchar_t*, size_t);
+
 			virtual size_t getSize() = 0;
-			virtual wchar_t* getWString() = 0;
+			virtual const wchar_t* getWString() = 0;
+			virtual UINT64 getHash() = 0;
+			virtual bool isInterned() = 0;
 		};
 	}
 
@@ -270,6 +347,7 @@ namespace WinFW {
 	namespace Exception {
 		class Exception : public virtual Ref {
 		public:
+			static constexpr unsigned long long RefID = Hidden::RefHash("WinFW::Exception::Exception");
 			DLL_DECLSPEC static const char* GetRefName();
 			DLL_DECLSPEC static Exception* New(const char*);
 
@@ -279,15 +357,162 @@ namespace WinFW {
 
 		class InvalidObjectException : public virtual Exception {
 		public:
+			static constexpr unsigned long long RefID = Hidden::RefHash("WinFW::Exception::InvalidObjectException");
 			DLL_DECLSPEC static const char* GetRefName();
 			DLL_DECLSPEC static InvalidObjectException* New(const char*);
 		};
 	}
 	
+	namespace Hidden {
+		// Not constexpr: combining conflicting style flags in a constant expression is a compile error.
+		inline void StyleConflict() {
+			assert(false && "Style : conflicting flags");
+		}
+
+		struct WinClassStyleTraits {
+			typedef UINT Value;
+
+			// At most one of the device context styles.
+			static constexpr bool isValid(UINT value) {
+				return (((value & CS_OWNDC) != 0) + ((value & CS_CLASSDC) != 0) + ((value & CS_PARENTDC) != 0)) <= 1;
+			}
+		};
+
+		struct WindowStyleTraits {
+			typedef DWORD Value;
+
+			static constexpr bool isValid(DWORD value) {
+				return (value & (WS_CHILD | WS_POPUP)) != (WS_CHILD | WS_POPUP) && (value & (WS_MINIMIZE | WS_MAXIMIZE)) != (WS_MINIMIZE | WS_MAXIMIZE);
+			}
+		};
+
+		struct WindowExStyleTraits {
+			typedef DWORD Value;
+
+			static constexpr bool isValid(DWORD) {
+				return true;
+			}
+		};
+
+		// Flag set value type : | combines and checks Traits::isValid, & masks.
+		template<typename Traits>
+		struct StyleFlags {
+			typedef typename Traits::Value Value;
+			Value value;
+
+			constexpr Value get() const {
+				return value;
+			}
+
+			constexpr bool has(StyleFlags flags) const {
+				return (value & flags.value) == flags.value;
+			}
+
+			friend constexpr StyleFlags operator|(StyleFlags lhs, StyleFlags rhs) {
+				StyleFlags res{ static_cast<Value>(lhs.value | rhs.value) };
+				if (!Traits::isValid(res.value)) StyleConflict();
+				return res;
+			}
+
+			friend constexpr StyleFlags operator&(StyleFlags lhs, StyleFlags rhs) {
+				return StyleFlags{ static_cast<Value>(lhs.value & rhs.value) };
+			}
+
+			constexpr StyleFlags& operator|=(StyleFlags rhs) {
+				return *this = *this | rhs;
+			}
+		};
+	}
+
+	// Header-only alternative to WinClassStyle / WindowStyle / WindowExStyle : the flags are constants and a
+	// combination is an integer, so passing one to setStyle / setExStyle allocates nothing. Declare the
+	// combination constexpr to have conflicting flags (Child | PopUp, Minimize | Maximize, OwnDC | ClassDC ...)
+	// rejected at compile time; otherwise they assert.
+	//
+	//	constexpr WindowStyleFlags style = WindowStyles::Caption | WindowStyles::SysMenu | WindowStyles::MinimizeBox;
+	typedef Hidden::StyleFlags<Hidden::WinClassStyleTraits> WinClassStyleFlags;
+	typedef Hidden::StyleFlags<Hidden::WindowStyleTraits> WindowStyleFlags;
+	typedef Hidden::StyleFlags<Hidden::WindowExStyleTraits> WindowExStyleFlags;
+
+	namespace WinClassStyles {
+		constexpr WinClassStyleFlags VRedraw{ static_cast<UINT>(CS_VREDRAW) };
+		constexpr WinClassStyleFlags HRedraw{ static_cast<UINT>(CS_HREDRAW) };
+		constexpr WinClassStyleFlags DBLCLKS{ static_cast<UINT>(CS_DBLCLKS) };
+		constexpr WinClassStyleFlags OwnDC{ static_cast<UINT>(CS_OWNDC) };
+		constexpr WinClassStyleFlags ClassDC{ static_cast<UINT>(CS_CLASSDC) };
+		constexpr WinClassStyleFlags ParentDC{ static_cast<UINT>(CS_PARENTDC) };
+		constexpr WinClassStyleFlags NoClose{ static_cast<UINT>(CS_NOCLOSE) };
+		constexpr WinClassStyleFlags SaveBits{ static_cast<UINT>(CS_SAVEBITS) };
+		constexpr WinClassStyleFlags ByteAlignClient{ static_cast<UINT>(CS_BYTEALIGNCLIENT) };
+		constexpr WinClassStyleFlags ByteAlignWindow{ static_cast<UINT>(CS_BYTEALIGNWINDOW) };
+		constexpr WinClassStyleFlags GlobalClass{ static_cast<UINT>(CS_GLOBALCLASS) };
+		constexpr WinClassStyleFlags DropShadow{ static_cast<UINT>(CS_DROPSHADOW) };
+	}
+
+	namespace WindowStyles {
+		constexpr WindowStyleFlags Caption{ static_cast<DWORD>(WS_CAPTION) };
+		constexpr WindowStyleFlags Child{ static_cast<DWORD>(WS_CHILD) };
+		constexpr WindowStyleFlags ChildWindow{ static_cast<DWORD>(WS_CHILDWINDOW) };
+		constexpr WindowStyleFlags ClipChildren{ static_cast<DWORD>(WS_CLIPCHILDREN) };
+		constexpr WindowStyleFlags ClipSiblings{ static_cast<DWORD>(WS_CLIPSIBLINGS) };
+		constexpr WindowStyleFlags Disabled{ static_cast<DWORD>(WS_DISABLED) };
+		constexpr WindowStyleFlags DLGFrame{ static_cast<DWORD>(WS_DLGFRAME) };
+		constexpr WindowStyleFlags Group{ static_cast<DWORD>(WS_GROUP) };
+		constexpr WindowStyleFlags HScroll{ static_cast<DWORD>(WS_HSCROLL) };
+		constexpr WindowStyleFlags Iconic{ static_cast<DWORD>(WS_ICONIC) };
+		constexpr WindowStyleFlags Maximize{ static_cast<DWORD>(WS_MAXIMIZE) };
+		constexpr WindowStyleFlags MaximizeBox{ static_cast<DWORD>(WS_MAXIMIZEBOX) };
+		constexpr WindowStyleFlags Minimize{ static_cast<DWORD>(WS_MINIMIZE) };
+		constexpr WindowStyleFlags MinimizeBox{ static_cast<DWORD>(WS_MINIMIZEBOX) };
+		constexpr WindowStyleFlags Overlapped{ static_cast<DWORD>(WS_OVERLAPPED) };
+		constexpr WindowStyleFlags OverlappedWindow{ static_cast<DWORD>(WS_OVERLAPPEDWINDOW) };
+		constexpr WindowStyleFlags PopUp{ static_cast<DWORD>(WS_POPUP) };
+		constexpr WindowStyleFlags PopUpWindow{ static_cast<DWORD>(WS_POPUPWINDOW) };
+		constexpr WindowStyleFlags SizeBox{ static_cast<DWORD>(WS_SIZEBOX) };
+		constexpr WindowStyleFlags SysMenu{ static_cast<DWORD>(WS_SYSMENU) };
+		constexpr WindowStyleFlags TabStop{ static_cast<DWORD>(WS_TABSTOP) };
+		constexpr WindowStyleFlags ThickFrame{ static_cast<DWORD>(WS_THICKFRAME) };
+		constexpr WindowStyleFlags Tiled{ static_cast<DWORD>(WS_TILED) };
+		constexpr WindowStyleFlags TiledWindow{ static_cast<DWORD>(WS_TILEDWINDOW) };
+		constexpr WindowStyleFlags Visible{ static_cast<DWORD>(WS_VISIBLE) };
+		constexpr WindowStyleFlags VScroll{ static_cast<DWORD>(WS_VSCROLL) };
+	}
+
+	namespace WindowExStyles {
+		constexpr WindowExStyleFlags AcceptFiles{ static_cast<DWORD>(WS_EX_ACCEPTFILES) };
+		constexpr WindowExStyleFlags AppWindow{ static_cast<DWORD>(WS_EX_APPWINDOW) };
+		constexpr WindowExStyleFlags ClientEdge{ static_cast<DWORD>(WS_EX_CLIENTEDGE) };
+		constexpr WindowExStyleFlags Composited{ static_cast<DWORD>(WS_EX_COMPOSITED) };
+		constexpr WindowExStyleFlags ContextHelp{ static_cast<DWORD>(WS_EX_CONTEXTHELP) };
+		constexpr WindowExStyleFlags ControlParent{ static_cast<DWORD>(WS_EX_CONTROLPARENT) };
+		constexpr WindowExStyleFlags DLGModalFrame{ static_cast<DWORD>(WS_EX_DLGMODALFRAME) };
+		constexpr WindowExStyleFlags Layered{ static_cast<DWORD>(WS_EX_LAYERED) };
+		constexpr WindowExStyleFlags LayoutRTL{ static_cast<DWORD>(WS_EX_LAYOUTRTL) };
+		constexpr WindowExStyleFlags Left{ static_cast<DWORD>(WS_EX_LEFT) };
+		constexpr WindowExStyleFlags LeftScrollBar{ static_cast<DWORD>(WS_EX_LEFTSCROLLBAR) };
+		constexpr WindowExStyleFlags LTRReadding{ static_cast<DWORD>(WS_EX_LTRREADING) };
+		constexpr WindowExStyleFlags MDIChild{ static_cast<DWORD>(WS_EX_MDICHILD) };
+		constexpr WindowExStyleFlags NoActivate{ static_cast<DWORD>(WS_EX_NOACTIVATE) };
+		constexpr WindowExStyleFlags NoInheriteLayout{ static_cast<DWORD>(WS_EX_NOINHERITLAYOUT) };
+		constexpr WindowExStyleFlags NoParentNotify{ static_cast<DWORD>(WS_EX_NOPARENTNOTIFY) };
+		constexpr WindowExStyleFlags NoRedirectBitmap{ static_cast<DWORD>(WS_EX_NOREDIRECTIONBITMAP) };
+		constexpr WindowExStyleFlags OverlappedWindow{ static_cast<DWORD>(WS_EX_OVERLAPPEDWINDOW) };
+		constexpr WindowExStyleFlags PaletteWindow{ static_cast<DWORD>(WS_EX_PALETTEWINDOW) };
+		constexpr WindowExStyleFlags Right{ static_cast<DWORD>(WS_EX_RIGHT) };
+		constexpr WindowExStyleFlags RightScrollBar{ static_cast<DWORD>(WS_EX_RIGHTSCROLLBAR) };
+		constexpr WindowExStyleFlags RTLReadding{ static_cast<DWORD>(WS_EX_RTLREADING) };
+		constexpr WindowExStyleFlags StaticEdge{ static_cast<DWORD>(WS_EX_STATICEDGE) };
+		constexpr WindowExStyleFlags ToolWindow{ static_cast<DWORD>(WS_EX_TOOLWINDOW) };
+		constexpr WindowExStyleFlags TopMost{ static_cast<DWORD>(WS_EX_TOPMOST) };
+		constexpr WindowExStyleFlags Transparent{ static_cast<DWORD>(WS_EX_TRANSPARENT) };
+		constexpr WindowExStyleFlags WindowEdge{ static_cast<DWORD>(WS_EX_WINDOWEDGE) };
+	}
+
 	class WinClassStyle : public virtual Copyable {
 	public:
+		static constexpr unsigned long long RefID = Hidden::RefHash("WinFW::WinClassStyle");
 		DLL_DECLSPEC static const char* GetRefName();
-		DLL_DECLSPEC static WinClassStyle* New();
+		DLL_DECLSPEC static WinClassStyle* New(RefPolicy = RefPolicy::Atomic);
 
 		virtual WinClassStyle* clear() = 0;
 		virtual WinClassStyle* VRedraw() = 0;
@@ -306,13 +531,15 @@ namespace WinFW {
 
 	class WinClassConfig : public virtual Copyable {
 	public:
+		static constexpr unsigned long long RefID = Hidden::RefHash("WinFW::WinClassConfig");
 		DLL_DECLSPEC static const char* GetRefName();
-		DLL_DECLSPEC static WinClassConfig* New(LPCWSTR, WNDPROC);
+		DLL_DECLSPEC static WinClassConfig* New(LPCWSTR, WNDPROC, RefPolicy = RefPolicy::Atomic);
 
 		virtual WinClassConfig* setWndProc(WNDPROC) = 0;
 		virtual WinClassConfig* setClassName(LPCWSTR) = 0;
 		virtual WinClassConfig* setStyle(WinClassStyle*&) = 0;
 		virtual WinClassConfig* setStyle(WinClassStyle*&&) = 0;
+		virtual WinClassConfig* setStyle(WinClassStyleFlags) = 0;
 		virtual WinClassConfig* setClsExtraBytes(int) = 0;
 		virtual WinClassConfig* setWndExtraBytes(int) = 0;
 		virtual WinClassConfig* setIcon(HICON) = 0;
@@ -324,6 +551,7 @@ namespace WinFW {
 
 	class WinClass : public virtual Ref {
 	public:
+		static constexpr unsigned long long RefID = Hidden::RefHash("WinFW::WinClass");
 		DLL_DECLSPEC static const char* GetRefName();
 		DLL_DECLSPEC static WinClass* New(WinClassConfig*&);
 		DLL_DECLSPEC static WinClass* New(WinClassConfig*&&);
@@ -333,8 +561,9 @@ namespace WinFW {
 
 	class WindowStyle : public virtual Copyable {
 	public:
+		static constexpr unsigned long long RefID = Hidden::RefHash("WinFW::WindowStyle");
 		DLL_DECLSPEC static const char* GetRefName();
-		DLL_DECLSPEC static WindowStyle* New();
+		DLL_DECLSPEC static WindowStyle* New(RefPolicy = RefPolicy::Atomic);
 
 		virtual WindowStyle* clear() = 0;
 		virtual WindowStyle* Caption() = 0;
@@ -367,8 +596,9 @@ namespace WinFW {
 
 	class WindowExStyle : public virtual Copyable {
 	public:
+		static constexpr unsigned long long RefID = Hidden::RefHash("WinFW::WindowExStyle");
 		DLL_DECLSPEC static const char* GetRefName();
-		DLL_DECLSPEC static WindowExStyle* New();
+		DLL_DECLSPEC static WindowExStyle* New(RefPolicy = RefPolicy::Atomic);
 
 		virtual WindowExStyle* clear() = 0;
 		virtual WindowExStyle* AcceptFiles() = 0;
@@ -402,9 +632,10 @@ namespace WinFW {
 
 	class WindowConfig : public virtual Copyable {
 	public:
+		static constexpr unsigned long long RefID = Hidden::RefHash("WinFW::WindowConfig");
 		DLL_DECLSPEC static const char* GetRefName();
-		DLL_DECLSPEC static WindowConfig* New(WinClass*&, int, int);
-		DLL_DECLSPEC static WindowConfig* New(WinClass*&&, int, int);
+		DLL_DECLSPEC static WindowConfig* New(WinClass*&, int, int, RefPolicy = RefPolicy::Atomic);
+		DLL_DECLSPEC static WindowConfig* New(WinClass*&&, int, int, RefPolicy = RefPolicy::Atomic);
 
 		virtual WindowConfig* setX(int) = 0;
 		virtual WindowConfig* setY(int) = 0;
@@ -414,20 +645,166 @@ namespace WinFW {
 		virtual WindowConfig* setWinClass(WinClass*&&) = 0;
 		virtual WindowConfig* setStyle(WindowStyle*&) = 0;
 		virtual WindowConfig* setStyle(WindowStyle*&&) = 0;
+		virtual WindowConfig* setStyle(WindowStyleFlags) = 0;
 		virtual WindowConfig* setExStyle(WindowExStyle*&) = 0;
 		virtual WindowConfig* setExStyle(WindowExStyle*&&) = 0;
+		virtual WindowConfig* setExStyle(WindowExStyleFlags) = 0;
 		virtual WindowConfig* setParent(HWND) = 0;
 		virtual WindowConfig* setMenu(HMENU) = 0;
 		virtual WindowConfig* setLpParam(LPVOID) = 0;
 		virtual WindowConfig* setTitle(LPCWSTR) = 0;
 	};
 
+	class Window;
+
+	struct WindowMessage {
+		UINT message;
+		WPARAM wParam;
+		LPARAM lParam;
+	};
+
+	typedef LRESULT (*MessageHandler)(Window*, const WindowMessage&, void*);
+
+	// Unpacked views of common messages, built from the WindowMessage they derive from, so a typed handler can
+	// still pass its message to Window::callDefault. Coordinates are client coordinates.
+	namespace Msg {
+		struct Close : WindowMessage {
+			static constexpr UINT ID = WM_CLOSE;
+			Close(const WindowMessage &msg) : WindowMessage(msg) {}
+		};
+
+		struct Destroy : WindowMessage {
+			static constexpr UINT ID = WM_DESTROY;
+			Destroy(const WindowMessage &msg) : WindowMessage(msg) {}
+		};
+
+		struct Paint : WindowMessage {
+			static constexpr UINT ID = WM_PAINT;
+			Paint(const WindowMessage &msg) : WindowMessage(msg) {}
+		};
+
+		struct Move : WindowMessage {
+			static constexpr UINT ID = WM_MOVE;
+			int x;
+			int y;
+			Move(const WindowMessage &msg) : WindowMessage(msg), x(static_cast<short>(LOWORD(msg.lParam))), y(static_cast<short>(HIWORD(msg.lParam))) {}
+		};
+
+		struct Size : WindowMessage {
+			static constexpr UINT ID = WM_SIZE;
+			UINT type;
+			int width;
+			int height;
+			Size(const WindowMessage &msg) : WindowMessage(msg), type(static_cast<UINT>(msg.wParam)), width(LOWORD(msg.lParam)), height(HIWORD(msg.lParam)) {}
+		};
+
+		template<UINT Message>
+		struct Focus : WindowMessage {
+			static constexpr UINT ID = Message;
+			HWND other;
+			Focus(const WindowMessage &msg) : WindowMessage(msg), other(reinterpret_cast<HWND>(msg.wParam)) {}
+		};
+
+		using SetFocus = Focus<WM_SETFOCUS>;
+		using KillFocus = Focus<WM_KILLFOCUS>;
+
+		struct Timer : WindowMessage {
+			static constexpr UINT ID = WM_TIMER;
+			UINT_PTR id;
+			Timer(const WindowMessage &msg) : WindowMessage(msg), id(static_cast<UINT_PTR>(msg.wParam)) {}
+		};
+
+		template<UINT Message>
+		struct Key : WindowMessage {
+			static constexpr UINT ID = Message;
+			BYTE vKey;
+			UINT repeat;
+			bool down;
+			bool wasDown;
+			Key(const WindowMessage &msg) : WindowMessage(msg), vKey(static_cast<BYTE>(msg.wParam)), repeat(LOWORD(msg.lParam)),
+				down((msg.lParam & (1U << 31)) == 0), wasDown((msg.lParam & (1 << 30)) != 0) {}
+		};
+
+		using KeyDown = Key<WM_KEYDOWN>;
+		using KeyUp = Key<WM_KEYUP>;
+		using SysKeyDown = Key<WM_SYSKEYDOWN>;
+		using SysKeyUp = Key<WM_SYSKEYUP>;
+
+		struct Char : WindowMessage {
+			static constexpr UINT ID = WM_CHAR;
+			wchar_t ch;
+			UINT repeat;
+			Char(const WindowMessage &msg) : WindowMessage(msg), ch(static_cast<wchar_t>(msg.wParam)), repeat(LOWORD(msg.lParam)) {}
+		};
+
+		// keys : MK_* flags held with the message.
+		template<UINT Message>
+		struct Mouse : WindowMessage {
+			static constexpr UINT ID = Message;
+			int x;
+			int y;
+			UINT keys;
+			Mouse(const WindowMessage &msg) : WindowMessage(msg), x(static_cast<short>(LOWORD(msg.lParam))), y(static_cast<short>(HIWORD(msg.lParam))),
+				keys(LOWORD(msg.wParam)) {}
+		};
+
+		using MouseMove = Mouse<WM_MOUSEMOVE>;
+		using LButtonDown = Mouse<WM_LBUTTONDOWN>;
+		using LButtonUp = Mouse<WM_LBUTTONUP>;
+		using RButtonDown = Mouse<WM_RBUTTONDOWN>;
+		using RButtonUp = Mouse<WM_RBUTTONUP>;
+		using MButtonDown = Mouse<WM_MBUTTONDOWN>;
+		using MButtonUp = Mouse<WM_MBUTTONUP>;
+
+		// delta : WHEEL_DELTA per notch. x, y are screen coordinates for wheel messages.
+		template<UINT Message>
+		struct Wheel : WindowMessage {
+			static constexpr UINT ID = Message;
+			int delta;
+			int x;
+			int y;
+			UINT keys;
+			Wheel(const WindowMessage &msg) : WindowMessage(msg), delta(static_cast<short>(HIWORD(msg.wParam))), x(static_cast<short>(LOWORD(msg.lParam))),
+				y(static_cast<short>(HIWORD(msg.lParam))), keys(LOWORD(msg.wParam)) {}
+		};
+
+		using MouseWheel = Wheel<WM_MOUSEWHEEL>;
+		using MouseHWheel = Wheel<WM_MOUSEHWHEEL>;
+	}
+
+	namespace Hidden {
+		template<typename Message, LRESULT (*Func)(Window*, const Message&, void*)>
+		LRESULT MessageThunk(Window *window, const WindowMessage &msg, void *ctx) {
+			return Func(window, Message(msg), ctx);
+		}
+	}
+
+	// Every window runs the library's window procedure once Window::New returned. It finds the Window through
+	// a window property, leaving GWLP_USERDATA to the class WNDPROC, and dispatches through a per-window
+	// table : a dense array indexed by message below WM_USER, a hash map above (WM_USER, WM_APP and
+	// registered messages). Messages without a handler go to the class WNDPROC, or to DefWindowProc when the
+	// class has none. Messages sent during CreateWindowEx (WM_CREATE ...)
+	// only reach the class WNDPROC. When the UI thread runs, handlers are set there : setHandler / on from the
+	// app thread are queued and return true once queued, and a released Window is deleted there too.
+	//
+	//	LRESULT onSize(Window *window, const Msg::Size &msg, void *ctx);
+	//	window->on<Msg::Size, &onSize>(renderer);
 	class Window : public virtual Ref {
 	public:
+		static constexpr unsigned long long RefID = Hidden::RefHash("WinFW::Window");
 		DLL_DECLSPEC static const char* GetRefName();
 		DLL_DECLSPEC static Window* New(WindowConfig*&, bool = true);
 		DLL_DECLSPEC static Window* New(WindowConfig*&&, bool = true);
 
+		virtual bool setHandler(UINT, MessageHandler, void* = nullptr) = 0;
+		virtual bool removeHandler(UINT) = 0;
+		virtual LRESULT callDefault(const WindowMessage&) = 0;
+
+		template<typename Message, LRESULT (*Func)(Window*, const Message&, void*)>
+		bool on(void *ctx = nullptr) {
+			return setHandler(Message::ID, &Hidden::MessageThunk<Message, Func>, ctx);
+		}
+
 		virtual HWND get() = 0;
 		virtual BOOL setTitle(LPCWSTR) = 0;
 		virtual BOOL hide() = 0;
@@ -441,11 +818,51 @@ namespace WinFW {
 		virtual BOOL queryClientSize(RECT*) const = 0;
 	};
 
+	struct PoolStats {
+		UINT64 hits;
+		UINT64 misses;
+	};
+
+	class DLL_DECLSPEC Pool {
+	public:
+		static PoolStats getStats();
+	};
+
+	struct TimeStats {
+		UINT count;
+		double min;
+		double mean;
+		double p50;
+		double p95;
+		double p99;
+		double max;
+	};
+
+	// loops : pumps run by EventLoop::isActive since resetStats. overruns : pumps the budget stopped with messages
+	// still queued. lastMessages, lastTime : messages dispatched and seconds spent by the last pump.
+	struct PumpStats {
+		UINT64 loops;
+		UINT64 overruns;
+		UINT64 messages;
+		UINT lastMessages;
+		double lastTime;
+		double maxTime;
+	};
+
 	class DLL_DECLSPEC EventLoop {
 	public:
+		static constexpr UINT StatsCapacity = 1024;
+		static constexpr UINT StatsBuckets = 80;
+
 		static void init();
 		static void destroy();
 		static bool fps(UINT);
+		static void setPacing(UINT);
+		static UINT getPacing();
+		static bool tick(UINT);
+		static void setMaxTicks(UINT);
+		static double getTickAlpha();
+		static UINT64 getDroppedTicks();
 		static MSG getMSG();
 		static INT64 getCurrentCount();
 		static INT64 getCountPerSecond();
@@ -453,27 +870,155 @@ namespace WinFW {
 		static INT64 getCountLastFrame();
 		static double getTimePerFrame();
 		static double getTimePerLoop();
+		static TimeStats getFrameStats();
+		static TimeStats getLoopStats();
+		static UINT getFrameHistogram(UINT*, UINT);
+		static UINT getLoopHistogram(UINT*, UINT);
+		static double getHistogramBucketTime(UINT);
+		static void resetStats();
+		static void setRawInputBatching(bool);
+		static bool getRawInputBatching();
+		static UINT getRawInputCount();
+		// Coalescing holds back WM_MOVE, WM_SIZE, WM_MOUSEMOVE and wheel messages of a Window and dispatches one of
+		// each per pump. getMergeCount : messages folded into the one being dispatched, 1 when none were.
+		static void setCoalescing(bool);
+		static bool getCoalescing();
+		static UINT64 getCoalescedCount();
+		static UINT getMergeCount();
+		// Per-loop limit on the message pump in seconds and messages, 0 for none. With a budget, input and paint
+		// messages are dispatched ahead of posted ones.
+		static void setPumpBudget(double, UINT = 0);
+		static PumpStats getPumpStats();
 		static bool isActive(HWND = nullptr, UINT = 0, UINT = 0, UINT = PM_REMOVE);
 	};
 
+	// Records what EventLoop::isActive retrieves (messages, raw input reports, loop times and fps() results) to a
+	// binary file, and replays such a file through the same dispatch path instead of live input. WM_INPUT is
+	// replayed to Mouse / Keyboard / InputQueue only, since its raw input handle cannot be recreated. Windows
+	// are numbered per session in creation order, so have the same windows alive and create them in the same
+	// order before replaying. Live messages are dropped while replaying, except WM_PAINT, WM_USER and up and
+	// WM_TIMER with a TIMERPROC, which are not recorded. With the UI thread running, a replayed message is
+	// dispatched on the thread that owns its window.
+	class DLL_DECLSPEC Recorder {
+	public:
+		static bool record(const char*);
+		static bool replay(const char*);
+		static void stop();
+		static bool isRecording();
+		static bool isReplaying();
+		static UINT64 getRecordCount();
+	};
+
+	// Creates windows and runs their message pump on a library-owned UI thread, so a modal move / size loop
+	// or a slow window procedure no longer stalls the update / render thread. Window procedures run on the
+	// UI thread; every message it retrieves is also forwarded over a lock-free queue and delivered to
+	// Keyboard, Mouse and InputQueue by EventLoop::isActive on the app thread. Window::New and the Window
+	// setters called from the app thread are forwarded to the UI thread; the setters are queued and return
+	// TRUE. invoke runs a function on the UI thread and waits for it. Windows created before start stay on
+	// the app thread and, like thread messages, are still pumped by EventLoop::isActive.
+	class DLL_DECLSPEC UIThread {
+	public:
+		static bool start(UINT = 4096);
+		static void stop();
+		static bool isRunning();
+		static bool isCurrent();
+		static void invoke(void (*)(void*), void*);
+		static UINT64 getDroppedMessages();
+	};
+
 	enum class KeyAction {
 		NoAction,
 		Press,
 		Release
 	};
 
+	// One bit per virtual key, bit (vKey & 63) of bits[vKey >> 6].
+	struct KeyMask {
+		UINT64 bits[4];
+
+		constexpr bool test(BYTE vKey) const {
+			return ((bits[vKey >> 6] >> (vKey & 63)) & 1) != 0;
+		}
+
+		constexpr bool any() const {
+			return (bits[0] | bits[1] | bits[2] | bits[3]) != 0;
+		}
+
+		// First key >= vKey in the mask, or -1.
+		int next(UINT vKey) const {
+			for (UINT word = vKey >> 6; word < 4; ++word) {
+				UINT64 value = bits[word];
+				if (word == vKey >> 6) value &= ~0ULL << (vKey & 63);
+				if (value != 0) return static_cast<int>(word * 64 + Hidden::LowestBit(value));
+			}
+			return -1;
+		}
+
+		template<typename Func>
+		void forEach(Func func) const {
+			for (int vKey = next(0); vKey >= 0; vKey = next(vKey + 1)) func(static_cast<BYTE>(vKey));
+		}
+
+		// Low word of the mask for a set of (1 << MouseButton) bits: Left, Right, Middle, X1, X2 are
+		// virtual keys 0x01, 0x02, 0x04, 0x05, 0x06.
+		static constexpr UINT64 FromMouseButtons(BYTE buttons) {
+			return ((buttons & 0x01) ? 1ULL << 0x01 : 0) | ((buttons & 0x02) ? 1ULL << 0x02 : 0) | ((buttons & 0x04) ? 1ULL << 0x04 : 0) |
+				((buttons & 0x08) ? 1ULL << 0x05 : 0) | ((buttons & 0x10) ? 1ULL << 0x06 : 0);
+		}
+	};
+
+	// Polling reads GetKeyboardState in update(). Messages follows the WM_KEYDOWN / WM_KEYUP messages retrieved by
+	// EventLoop::isActive, so keys pressed and released between two updates are still reported.
+	enum class KeyboardSource {
+		Polling,
+		Messages
+	};
+
+	struct KeyTransition {
+		BYTE vKey;
+		bool down;
+		DWORD time;
+	};
+
+	// update() takes a snapshot of the whole keyboard; every query below reads that snapshot and has no side effects.
 	class Keyboard : public virtual Ref {
 	public:
+		static constexpr unsigned long long RefID = Hidden::RefHash("WinFW::Keyboard");
+		static constexpr UINT MaxTransitions = 64;
 		DLL_DECLSPEC static const char* GetRefName();
-		DLL_DECLSPEC static Keyboard* New();
+		DLL_DECLSPEC static Keyboard* New(KeyboardSource = KeyboardSource::Polling);
 
 		virtual BOOL update() = 0;
 		virtual KeyAction getKeyAction(BYTE) = 0;
 		virtual bool isPress(BYTE) = 0;
+		virtual bool wasPressed(BYTE) = 0;
+		virtual bool wasReleased(BYTE) = 0;
+		virtual const KeyMask& getHeld() = 0;
+		virtual const KeyMask& getPressed() = 0;
+		virtual const KeyMask& getReleased() = 0;
+		virtual KeyboardSource getSource() = 0;
+		virtual UINT getTransitionCount() = 0;
+		virtual const KeyTransition* getTransitions() = 0;
+	};
+
+	enum class MouseButton : BYTE {
+		Left,
+		Right,
+		Middle,
+		X1,
+		X2
+	};
+
+	// One bit per MouseButton, (1 << button). pressed / released collect every transition since the last pass.
+	struct MouseButtons {
+		BYTE held;
+		BYTE pressed;
+		BYTE released;
 	};
 
 	class Mouse : public virtual Ref {
 	public:
+		static constexpr unsigned long long RefID = Hidden::RefHash("WinFW::Mouse");
 		DLL_DECLSPEC static const char* GetRefName();
 		DLL_DECLSPEC static Mouse* New();
 
@@ -486,10 +1031,315 @@ namespace WinFW {
 		virtual int getPosY() = 0;
 		virtual void updateRawMouseMove(LPARAM) = 0;
 		virtual POINT passMove() = 0;
+		virtual MouseButtons passButtons() = 0;
+		virtual POINT passWheel() = 0;
+		virtual bool isButtonDown(MouseButton) = 0;
+	};
+
+	namespace Hidden {
+		// Not constexpr: reaching it while building a constexpr ActionMap is a compile error.
+		inline void ActionOutOfRange() {
+			assert(false && "ActionMap : action out of range");
+		}
+	}
+
+	struct KeyBinding {
+		BYTE vKey;
+		UINT action;
 	};
+
+	struct ActionState {
+		bool held;
+		bool pressed;
+		bool released;
+	};
+
+	// Key masks per action, built from KeyBinding arrays (at compile time when constexpr). evaluate() ORs the
+	// bound keys of every action in one pass over the masks, so its cost depends on the action count only.
+	// bind / unbind edit the masks in place.
+	//
+	//	enum Action : UINT { Jump, Fire, NumActions };
+	//	constexpr KeyBinding bindings[] = { { VK_SPACE, Jump }, { 'W', Jump }, { VK_LBUTTON, Fire } };
+	//	ActionMap<NumActions> actions(bindings);
+	template<UINT NumActions>
+	class ActionMap {
+		KeyMask m_masks[NumActions];
+	public:
+		constexpr ActionMap() : m_masks{} {
+		}
+
+		template<size_t NumBindings>
+		constexpr ActionMap(const KeyBinding (&bindings)[NumBindings]) : m_masks{} {
+			for (size_t i = 0; i < NumBindings; ++i) bind(bindings[i].vKey, bindings[i].action);
+		}
+
+		constexpr void bind(BYTE vKey, UINT action) {
+			if (action < NumActions) m_masks[action].bits[vKey >> 6] |= 1ULL << (vKey & 63);
+			else Hidden::ActionOutOfRange();
+		}
+
+		constexpr void unbind(BYTE vKey, UINT action) {
+			if (action < NumActions) m_masks[action].bits[vKey >> 6] &= ~(1ULL << (vKey & 63));
+			else Hidden::ActionOutOfRange();
+		}
+
+		void unbindKey(BYTE vKey) {
+			for (UINT action = 0; action < NumActions; ++action) m_masks[action].bits[vKey >> 6] &= ~(1ULL << (vKey & 63));
+		}
+
+		void clear(UINT action) {
+			if (action < NumActions) m_masks[action] = KeyMask{};
+			else Hidden::ActionOutOfRange();
+		}
+
+		constexpr bool isBound(BYTE vKey, UINT action) const {
+			return action < NumActions && m_masks[action].test(vKey);
+		}
+
+		const KeyMask& getKeys(UINT action) const {
+			return m_masks[action];
+		}
+
+		void evaluate(const KeyMask &held, const KeyMask &pressed, const KeyMask &released, ActionState *states) const {
+			for (UINT action = 0; action < NumActions; ++action) {
+				const UINT64 *keys = m_masks[action].bits;
+				states[action].held = ((held.bits[0] & keys[0]) | (held.bits[1] & keys[1]) | (held.bits[2] & keys[2]) | (held.bits[3] & keys[3])) != 0;
+				states[action].pressed = ((pressed.bits[0] & keys[0]) | (pressed.bits[1] & keys[1]) | (pressed.bits[2] & keys[2]) | (pressed.bits[3] & keys[3])) != 0;
+				states[action].released = ((released.bits[0] & keys[0]) | (released.bits[1] & keys[1]) | (released.bits[2] & keys[2]) | (released.bits[3] & keys[3])) != 0;
+			}
+		}
+
+		void evaluate(Keyboard *keyboard, ActionState *states) const {
+			evaluate(keyboard->getHeld(), keyboard->getPressed(), keyboard->getReleased(), states);
+		}
+
+		// Mouse buttons count as their VK_LBUTTON .. VK_XBUTTON2 keys.
+		void evaluate(Keyboard *keyboard, const MouseButtons &buttons, ActionState *states) const {
+			KeyMask held = keyboard->getHeld();
+			KeyMask pressed = keyboard->getPressed();
+			KeyMask released = keyboard->getReleased();
+			held.bits[0] |= KeyMask::FromMouseButtons(buttons.held);
+			pressed.bits[0] |= KeyMask::FromMouseButtons(buttons.pressed);
+			released.bits[0] |= KeyMask::FromMouseButtons(buttons.released);
+			evaluate(held, pressed, released, states);
+		}
+	};
+
+	enum class InputEventType : BYTE {
+		Key,
+		Button,
+		Move,
+		RawMove,
+		Wheel
+	};
+
+	// Key: code = vKey. Button: code = MouseButton. Move: x, y = client position. RawMove: x, y = raw delta.
+	// Wheel: x = horizontal, y = vertical delta. time = QueryPerformanceCounter when the message was retrieved.
+	struct InputEvent {
+		InputEventType type;
+		BYTE code;
+		bool down;
+		LONG x;
+		LONG y;
+		INT64 time;
+	};
+
+	// Bounded single-producer / single-consumer ring. EventLoop::isActive is the only producer, one other
+	// thread (or the same one) consumes. Create and release the queue on the EventLoop thread.
+	class InputQueue : public virtual Ref {
+	public:
+		static constexpr unsigned long long RefID = Hidden::RefHash("WinFW::InputQueue");
+		DLL_DECLSPEC static const char* GetRefName();
+		DLL_DECLSPEC static InputQueue* New(UINT = 1024);
+
+		virtual bool pop(InputEvent&) = 0;
+		virtual UINT drain(InputEvent*, UINT) = 0;
+		virtual UINT getSize() = 0;
+		virtual UINT getCapacity() = 0;
+		virtual UINT64 getDropped() = 0;
+	};
+
+	typedef void (*JobFunc)(void*);
+
+	// Counts unfinished jobs. JobSystem::run holds the counter of a job up until the job has run, and a job
+	// that depends on a counter is held back until that counter drops to 0.
+	class JobCounter : public virtual Ref {
+	public:
+		static constexpr unsigned long long RefID = Hidden::RefHash("WinFW::JobCounter");
+		DLL_DECLSPEC static const char* GetRefName();
+		DLL_DECLSPEC static JobCounter* New();
+
+		virtual UINT getPending() = 0;
+		virtual bool isDone() = 0;
+	};
+
+	// busyTime : seconds spent running jobs. utilization : busyTime over the time since start / resetStats.
+	struct WorkerStats {
+		UINT64 jobs;
+		UINT64 steals;
+		double busyTime;
+		double utilization;
+	};
+
+	// Work-stealing scheduler. Every worker, and the thread that called start (worker 0), owns a Chase-Lev
+	// deque : it runs its own jobs newest first, idle workers steal the oldest. Jobs run from any other
+	// thread go through a shared queue. wait runs jobs until the counter is done. Frame jobs (runFrame) are
+	// waited for by the next EventLoop::fps that returns true. Without start, jobs run in place.
+	class DLL_DECLSPEC JobSystem {
+	public:
+		static bool start(UINT = 0);
+		static void stop();
+		static bool isRunning();
+		static UINT getWorkerCount();
+		static bool run(JobFunc, void*, JobCounter* = nullptr, JobCounter* = nullptr);
+		static bool runFrame(JobFunc, void*, JobCounter* = nullptr);
+		static void wait(JobCounter*);
+		static void waitFrame();
+		static WorkerStats getWorkerStats(UINT);
+		static void resetStats();
+	};
+
+	// Callbacks resumed by the EventLoop, each exactly once : onNextFrame when fps next returns true,
+	// onDelay from the first isActive past the delay, onKeyPressed from the isActive that retrieved a press
+	// of the key. Use them from the EventLoop thread. allocate / release back the frames of Task.
+	class DLL_DECLSPEC Coroutine {
+	public:
+		static bool onNextFrame(JobFunc, void*);
+		static bool onDelay(double, JobFunc, void*);
+		static bool onKeyPressed(BYTE, JobFunc, void*);
+		static UINT getSuspendedCount();
+		static void* allocate(size_t);
+		static void release(void*, size_t);
+	};
+
+	// Callbacks fired from EventLoop::isActive on the EventLoop thread, never before their due time and at most
+	// one wheel tick (1 ms) plus one loop after it. A period > 0 repeats the timer. An ID stays valid until
+	// the timer is cancelled or, for a one-shot timer, fired; cancel on a stale ID returns false.
+	// getNextDeadline : earliest QPC count a pending timer can fire at, 0 when none is pending.
+	class DLL_DECLSPEC Timer {
+	public:
+		static UINT64 schedule(double, JobFunc, void*, double = 0.0);
+		static bool cancel(UINT64);
+		static UINT getPendingCount();
+		static INT64 getNextDeadline();
+	};
+
+#ifdef WINFW_COROUTINES
+	namespace Hidden {
+		inline void ResumeCoroutine(void *address) {
+			std::coroutine_handle<>::from_address(address).resume();
+		}
+	}
+
+	// Fire-and-forget coroutine : it runs up to its first co_await right away, and its frame, taken from the
+	// Coroutine pool, is freed when it finishes.
+	struct Task {
+		struct promise_type {
+			Task get_return_object() noexcept {
+				return {};
+			}
+
+			std::suspend_never initial_suspend() noexcept {
+				return {};
+			}
+
+			std::suspend_never final_suspend() noexcept {
+				return {};
+			}
+
+			void return_void() noexcept {
+			}
+
+			void unhandled_exception() noexcept {
+				std::terminate();
+			}
+
+			static void* operator new(size_t size) {
+				return Coroutine::allocate(size);
+			}
+
+			static void operator delete(void *ptr, size_t size) {
+				Coroutine::release(ptr, size);
+			}
+		};
+	};
+
+	// await_suspend throws std::bad_alloc when the waiter could not be queued, so co_await reports the failure
+	// instead of resuming as if the event had happened.
+	struct NextFrameAwaiter {
+		bool await_ready() const noexcept {
+			return false;
+		}
+
+		void await_suspend(std::coroutine_handle<> handle) const {
+			if (!Coroutine::onNextFrame(&Hidden::ResumeCoroutine, handle.address())) throw std::bad_alloc();
+		}
+
+		void await_resume() const noexcept {
+		}
+	};
+
+	struct DelayAwaiter {
+		double seconds;
+
+		bool await_ready() const noexcept {
+			return false;
+		}
+
+		void await_suspend(std::coroutine_handle<> handle) const {
+			if (!Coroutine::onDelay(seconds, &Hidden::ResumeCoroutine, handle.address())) throw std::bad_alloc();
+		}
+
+		void await_resume() const noexcept {
+		}
+	};
+
+	struct KeyPressedAwaiter {
+		BYTE vKey;
+
+		bool await_ready() const noexcept {
+			return false;
+		}
+
+		void await_suspend(std::coroutine_handle<> handle) const {
+			if (!Coroutine::onKeyPressed(vKey, &Hidden::ResumeCoroutine, handle.address())) throw std::bad_alloc();
+		}
+
+		void await_resume() const noexcept {
+		}
+	};
+
+	inline NextFrameAwaiter nextFrame() {
+		return {};
+	}
+
+	inline DelayAwaiter delay(double seconds) {
+		return { seconds };
+	}
+
+	inline KeyPressedAwaiter keyPressed(BYTE vKey) {
+		return { vKey };
+	}
+#endif
+
+#ifdef WINFW_HEADLESS
+	class DLL_DECLSPEC Headless {
+	public:
+		static void reset();
+		static void postMessage(HWND, UINT, WPARAM, LPARAM);
+		static void postKey(HWND, BYTE, bool);
+		static bool postRawInput(HWND, const RAWINPUT&);
+		static bool postRawMouseMove(HWND, LONG, LONG);
+		static void setKeyState(BYTE, bool);
+		static void setCursorPos(int, int);
+		static size_t getPendingMessages();
+		static void useManualClock(bool);
+		static void advanceClock(INT64);
+	};
+#endif
 }
 
-#ifdef USE_MAIN
+#if defined(USE_MAIN) && !defined(WINFW_HEADLESS)
 int main(HINSTANCE, char*, int);
 
 int APIENTRY WinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance, _In_ LPSTR lpCmdLine, _In_ int nCmdShow) {
@@ -510,4 +1360,4 @@ int APIENTRY WinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance,
 #endif
 
 #pragma pop_macro("DLL_DECLSPEC") 
-#pragma pop_macro("WIN32_LEAN_AND_MEAN")
\ No newline at end of file
+#pragma pop_macro("WIN32_LEAN_AND_MEAN")
\ No newline at end of file
@@ -0,0 +1,438 @@
+#pragma once
+
+// Headless backend : the subset of the Win32 API used by WinFW, backed by a fake message queue,
+// a monotonic clock and synthetic keyboard / mouse state (see WinFW::Headless).
+
+#include <cstddef>
+#include <cstdint>
+
+#define CALLBACK
+#define WINAPI
+#define APIENTRY
+
+#ifndef NULL
+#define NULL 0
+#endif
+
+#define TRUE 1
+#define FALSE 0
+
+typedef int BOOL;
+typedef unsigned char BYTE;
+typedef BYTE *PBYTE;
+typedef unsigned short WORD;
+typedef unsigned short USHORT;
+typedef short SHORT;
+typedef std::uint32_t DWORD;
+typedef DWORD *LPDWORD;
+typedef std::int32_t LONG;
+typedef std::uint32_t ULONG;
+typedef int INT;
+typedef unsigned int UINT;
+typedef UINT *PUINT;
+typedef std::int64_t INT64;
+typedef std::uint64_t UINT64;
+typedef std::int64_t LONGLONG;
+typedef std::intptr_t LONG_PTR;
+typedef std::uintptr_t ULONG_PTR;
+typedef std::uintptr_t UINT_PTR;
+typedef std::uintptr_t WPARAM;
+typedef std::intptr_t LPARAM;
+typedef std::intptr_t LRESULT;
+typedef WORD ATOM;
+typedef void *LPVOID;
+typedef void *HANDLE;
+typedef wchar_t WCHAR;
+typedef WCHAR *LPWSTR;
+typedef const WCHAR *LPCWSTR;
+typedef char *LPSTR;
+typedef const char *LPCSTR;
+
+#define WINFW_DECLARE_HANDLE(name) struct name##__; typedef name##__ *name
+
+WINFW_DECLARE_HANDLE(HWND);
+WINFW_DECLARE_HANDLE(HINSTANCE);
+WINFW_DECLARE_HANDLE(HICON);
+WINFW_DECLARE_HANDLE(HBRUSH);
+WINFW_DECLARE_HANDLE(HMENU);
+WINFW_DECLARE_HANDLE(HRAWINPUT);
+typedef HICON HCURSOR;
+
+#undef WINFW_DECLARE_HANDLE
+
+typedef LRESULT(CALLBACK *WNDPROC)(HWND, UINT, WPARAM, LPARAM);
+
+struct POINT {
+	LONG x;
+	LONG y;
+};
+
+struct RECT {
+	LONG left;
+	LONG top;
+	LONG right;
+	LONG bottom;
+};
+typedef RECT *LPRECT;
+
+struct MSG {
+	HWND hwnd;
+	UINT message;
+	WPARAM wParam;
+	LPARAM lParam;
+	DWORD time;
+	POINT pt;
+};
+typedef MSG *LPMSG;
+
+union LARGE_INTEGER {
+	LONGLONG QuadPart;
+};
+
+struct WNDCLASSEXW {
+	UINT cbSize;
+	UINT style;
+	WNDPROC lpfnWndProc;
+	int cbClsExtra;
+	int cbWndExtra;
+	HINSTANCE hInstance;
+	HICON hIcon;
+	HCURSOR hCursor;
+	HBRUSH hbrBackground;
+	LPCWSTR lpszMenuName;
+	LPCWSTR lpszClassName;
+	HICON hIconSm;
+};
+
+struct RAWINPUTDEVICE {
+	USHORT usUsagePage;
+	USHORT usUsage;
+	DWORD dwFlags;
+	HWND hwndTarget;
+};
+
+struct RAWINPUTHEADER {
+	DWORD dwType;
+	DWORD dwSize;
+	HANDLE hDevice;
+	WPARAM wParam;
+};
+
+struct RAWMOUSE {
+	USHORT usFlags;
+	union {
+		ULONG ulButtons;
+		struct {
+			USHORT usButtonFlags;
+			USHORT usButtonData;
+		};
+	};
+	ULONG ulRawButtons;
+	LONG lLastX;
+	LONG lLastY;
+	ULONG ulExtraInformation;
+};
+
+struct RAWKEYBOARD {
+	USHORT MakeCode;
+	USHORT Flags;
+	USHORT Reserved;
+	USHORT VKey;
+	UINT Message;
+	ULONG ExtraInformation;
+};
+
+struct RAWINPUT {
+	RAWINPUTHEADER header;
+	union {
+		RAWMOUSE mouse;
+		RAWKEYBOARD keyboard;
+	} data;
+};
+typedef RAWINPUT *PRAWINPUT;
+
+#define RAWINPUT_ALIGN(x) (((x) + sizeof(ULONG_PTR) - 1) & ~(sizeof(ULONG_PTR) - 1))
+#define NEXTRAWINPUTBLOCK(ptr) (reinterpret_cast<PRAWINPUT>(RAWINPUT_ALIGN(reinterpret_cast<ULONG_PTR>(reinterpret_cast<BYTE*>(ptr) + (ptr)->header.dwSize))))
+
+#define MAKEINTRESOURCEW(i) (reinterpret_cast<LPWSTR>(static_cast<ULONG_PTR>(static_cast<WORD>(i))))
+#define IDC_ARROW MAKEINTRESOURCEW(32512)
+
+#define MAKELPARAM(l, h) (static_cast<LPARAM>(static_cast<DWORD>((static_cast<WORD>(l)) | (static_cast<DWORD>(static_cast<WORD>(h)) << 16))))
+#define LOWORD(l) (static_cast<WORD>(static_cast<ULONG_PTR>(l) & 0xffff))
+#define HIWORD(l) (static_cast<WORD>((static_cast<ULONG_PTR>(l) >> 16) & 0xffff))
+#define GET_X_LPARAM(lp) (static_cast<int>(static_cast<short>(static_cast<WORD>(static_cast<ULONG_PTR>(lp) & 0xffff))))
+#define GET_Y_LPARAM(lp) (static_cast<int>(static_cast<short>(static_cast<WORD>((static_cast<ULONG_PTR>(lp) >> 16) & 0xffff))))
+#define GET_WHEEL_DELTA_WPARAM(wp) (static_cast<short>(static_cast<WORD>((static_cast<ULONG_PTR>(wp) >> 16) & 0xffff)))
+#define GET_XBUTTON_WPARAM(wp) (static_cast<WORD>((static_cast<ULONG_PTR>(wp) >> 16) & 0xffff))
+#define XBUTTON1 0x0001
+#define XBUTTON2 0x0002
+
+#define COLOR_WINDOW 5
+#define CW_USEDEFAULT (static_cast<int>(0x80000000))
+
+#define PM_NOREMOVE 0x0000
+#define PM_REMOVE 0x0001
+#define PM_QS_INPUT (QS_INPUT << 16)
+#define PM_QS_PAINT (QS_PAINT << 16)
+
+#define MB_OK 0x00000000L
+#define MB_ICONERROR 0x00000010L
+#define MB_ICONINFORMATION 0x00000040L
+#define IDOK 1
+
+#define WM_NULL 0x0000
+#define WM_CREATE 0x0001
+#define WM_DESTROY 0x0002
+#define WM_MOVE 0x0003
+#define WM_SIZE 0x0005
+#define WM_SETFOCUS 0x0007
+#define WM_KILLFOCUS 0x0008
+#define WM_PAINT 0x000F
+#define WM_CLOSE 0x0010
+#define WM_QUIT 0x0012
+#define WM_NCDESTROY 0x0082
+#define WM_TIMER 0x0113
+#define WM_INPUT 0x00FF
+#define WM_KEYFIRST 0x0100
+#define WM_KEYDOWN 0x0100
+#define WM_KEYUP 0x0101
+#define WM_CHAR 0x0102
+#define WM_SYSKEYDOWN 0x0104
+#define WM_SYSKEYUP 0x0105
+#define WM_KEYLAST 0x0109
+#define WM_MOUSEFIRST 0x0200
+#define WM_MOUSEMOVE 0x0200
+#define WM_LBUTTONDOWN 0x0201
+#define WM_LBUTTONUP 0x0202
+#define WM_RBUTTONDOWN 0x0204
+#define WM_RBUTTONUP 0x0205
+#define WM_MBUTTONDOWN 0x0207
+#define WM_MBUTTONUP 0x0208
+#define WM_MOUSEWHEEL 0x020A
+#define WM_XBUTTONDOWN 0x020B
+#define WM_XBUTTONUP 0x020C
+#define WM_MOUSEHWHEEL 0x020E
+#define WM_MOUSELAST 0x020E
+#define WM_ENTERSIZEMOVE 0x0231
+#define WM_EXITSIZEMOVE 0x0232
+#define WM_USER 0x0400
+#define WM_APP 0x8000
+
+#define VK_LBUTTON 0x01
+#define VK_RBUTTON 0x02
+#define VK_MBUTTON 0x04
+#define VK_XBUTTON1 0x05
+#define VK_XBUTTON2 0x06
+#define VK_BACK 0x08
+#define VK_TAB 0x09
+#define VK_RETURN 0x0D
+#define VK_SHIFT 0x10
+#define VK_CONTROL 0x11
+#define VK_MENU 0x12
+#define VK_ESCAPE 0x1B
+#define VK_SPACE 0x20
+#define VK_LEFT 0x25
+#define VK_UP 0x26
+#define VK_RIGHT 0x27
+#define VK_DOWN 0x28
+
+#define WHEEL_DELTA 120
+
+#define CS_VREDRAW 0x0001
+#define CS_HREDRAW 0x0002
+#define CS_DBLCLKS 0x0008
+#define CS_OWNDC 0x0020
+#define CS_CLASSDC 0x0040
+#define CS_PARENTDC 0x0080
+#define CS_NOCLOSE 0x0200
+#define CS_SAVEBITS 0x0800
+#define CS_BYTEALIGNCLIENT 0x1000
+#define CS_BYTEALIGNWINDOW 0x2000
+#define CS_GLOBALCLASS 0x4000
+#define CS_DROPSHADOW 0x00020000
+
+#define WS_OVERLAPPED 0x00000000L
+#define WS_POPUP 0x80000000L
+#define WS_CHILD 0x40000000L
+#define WS_MINIMIZE 0x20000000L
+#define WS_VISIBLE 0x10000000L
+#define WS_DISABLED 0x08000000L
+#define WS_CLIPSIBLINGS 0x04000000L
+#define WS_CLIPCHILDREN 0x02000000L
+#define WS_MAXIMIZE 0x01000000L
+#define WS_CAPTION 0x00C00000L
+#define WS_BORDER 0x00800000L
+#define WS_DLGFRAME 0x00400000L
+#define WS_VSCROLL 0x00200000L
+#define WS_HSCROLL 0x00100000L
+#define WS_SYSMENU 0x00080000L
+#define WS_THICKFRAME 0x00040000L
+#define WS_GROUP 0x00020000L
+#define WS_TABSTOP 0x00010000L
+#define WS_MINIMIZEBOX 0x00020000L
+#define WS_MAXIMIZEBOX 0x00010000L
+#define WS_TILED WS_OVERLAPPED
+#define WS_ICONIC WS_MINIMIZE
+#define WS_SIZEBOX WS_THICKFRAME
+#define WS_OVERLAPPEDWINDOW (WS_OVERLAPPED | WS_CAPTION | WS_SYSMENU | WS_THICKFRAME | WS_MINIMIZEBOX | WS_MAXIMIZEBOX)
+#define WS_TILEDWINDOW WS_OVERLAPPEDWINDOW
+#define WS_POPUPWINDOW (WS_POPUP | WS_BORDER | WS_SYSMENU)
+#define WS_CHILDWINDOW WS_CHILD
+
+#define WS_EX_DLGMODALFRAME 0x00000001L
+#define WS_EX_NOPARENTNOTIFY 0x00000004L
+#define WS_EX_TOPMOST 0x00000008L
+#define WS_EX_ACCEPTFILES 0x00000010L
+#define WS_EX_TRANSPARENT 0x00000020L
+#define WS_EX_MDICHILD 0x00000040L
+#define WS_EX_TOOLWINDOW 0x00000080L
+#define WS_EX_WINDOWEDGE 0x00000100L
+#define WS_EX_CLIENTEDGE 0x00000200L
+#define WS_EX_CONTEXTHELP 0x00000400L
+#define WS_EX_RIGHT 0x00001000L
+#define WS_EX_LEFT 0x00000000L
+#define WS_EX_RTLREADING 0x00002000L
+#define WS_EX_LTRREADING 0x00000000L
+#define WS_EX_LEFTSCROLLBAR 0x00004000L
+#define WS_EX_RIGHTSCROLLBAR 0x00000000L
+#define WS_EX_CONTROLPARENT 0x00010000L
+#define WS_EX_STATICEDGE 0x00020000L
+#define WS_EX_APPWINDOW 0x00040000L
+#define WS_EX_LAYERED 0x00080000
+#define WS_EX_NOINHERITLAYOUT 0x00100000L
+#define WS_EX_NOREDIRECTIONBITMAP 0x00200000L
+#define WS_EX_LAYOUTRTL 0x00400000L
+#define WS_EX_COMPOSITED 0x02000000L
+#define WS_EX_NOACTIVATE 0x08000000L
+#define WS_EX_OVERLAPPEDWINDOW (WS_EX_WINDOWEDGE | WS_EX_CLIENTEDGE)
+#define WS_EX_PALETTEWINDOW (WS_EX_WINDOWEDGE | WS_EX_TOOLWINDOW | WS_EX_TOPMOST)
+
+#define SW_HIDE 0
+#define SW_SHOW 5
+#define SW_MINIMIZE 6
+
+#define SIZE_RESTORED 0
+
+#define SWP_NOSIZE 0x0001
+#define SWP_NOMOVE 0x0002
+
+#define GWL_STYLE (-16)
+#define GWL_EXSTYLE (-20)
+#define GWLP_WNDPROC (-4)
+#define GWLP_USERDATA (-21)
+
+#define RIDEV_REMOVE 0x00000001
+#define RID_INPUT 0x10000003
+#define RIM_TYPEMOUSE 0
+#define RIM_TYPEKEYBOARD 1
+
+#define MOUSE_MOVE_RELATIVE 0
+#define MOUSE_MOVE_ABSOLUTE 1
+#define MOUSE_VIRTUAL_DESKTOP 0x02
+
+#define RI_MOUSE_LEFT_BUTTON_DOWN 0x0001
+#define RI_MOUSE_LEFT_BUTTON_UP 0x0002
+#define RI_MOUSE_RIGHT_BUTTON_DOWN 0x0004
+#define RI_MOUSE_RIGHT_BUTTON_UP 0x0008
+#define RI_MOUSE_MIDDLE_BUTTON_DOWN 0x0010
+#define RI_MOUSE_MIDDLE_BUTTON_UP 0x0020
+#define RI_MOUSE_BUTTON_4_DOWN 0x0040
+#define RI_MOUSE_BUTTON_4_UP 0x0080
+#define RI_MOUSE_BUTTON_5_DOWN 0x0100
+#define RI_MOUSE_BUTTON_5_UP 0x0200
+#define RI_MOUSE_WHEEL 0x0400
+#define RI_MOUSE_HWHEEL 0x0800
+
+#define RI_KEY_MAKE 0
+#define RI_KEY_BREAK 1
+
+#define INFINITE 0xFFFFFFFF
+#define WAIT_OBJECT_0 0x00000000L
+#define WAIT_TIMEOUT 258L
+#define WAIT_FAILED 0xFFFFFFFF
+
+#define QS_KEY 0x0001
+#define QS_MOUSEMOVE 0x0002
+#define QS_MOUSEBUTTON 0x0004
+#define QS_POSTMESSAGE 0x0008
+#define QS_TIMER 0x0010
+#define QS_PAINT 0x0020
+#define QS_RAWINPUT 0x0400
+#define QS_MOUSE (QS_MOUSEMOVE | QS_MOUSEBUTTON)
+#define QS_INPUT (QS_MOUSE | QS_KEY | QS_RAWINPUT)
+#define QS_ALLINPUT 0x04FF
+#define MWMO_INPUTAVAILABLE 0x0004
+
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#define TIMER_ALL_ACCESS 0x001F0003
+
+#define SM_CXSCREEN 0
+#define SM_CYSCREEN 1
+#define SM_XVIRTUALSCREEN 76
+#define SM_YVIRTUALSCREEN 77
+#define SM_CXVIRTUALSCREEN 78
+#define SM_CYVIRTUALSCREEN 79
+
+#define DefWindowProc DefWindowProcW
+
+inline LONG InterlockedIncrement(LONG volatile *addend) {
+	return __atomic_add_fetch(addend, 1, __ATOMIC_SEQ_CST);
+}
+
+inline LONG InterlockedDecrement(LONG volatile *addend) {
+	return __atomic_sub_fetch(addend, 1, __ATOMIC_SEQ_CST);
+}
+
+inline unsigned long long InterlockedIncrement(unsigned long long volatile *addend) {
+	return __atomic_add_fetch(addend, 1ULL, __ATOMIC_SEQ_CST);
+}
+
+inline unsigned long long InterlockedDecrement(unsigned long long volatile *addend) {
+	return __atomic_sub_fetch(addend, 1ULL, __ATOMIC_SEQ_CST);
+}
+
+int MessageBoxA(HWND, LPCSTR, LPCSTR, UINT);
+int MessageBoxW(HWND, LPCWSTR, LPCWSTR, UINT);
+BOOL QueryPerformanceFrequency(LARGE_INTEGER*);
+BOOL QueryPerformanceCounter(LARGE_INTEGER*);
+BOOL PeekMessageW(LPMSG, HWND, UINT, UINT, UINT);
+BOOL PostMessageW(HWND, UINT, WPARAM, LPARAM);
+BOOL TranslateMessage(const MSG*);
+LRESULT DispatchMessageW(const MSG*);
+LRESULT DefWindowProcW(HWND, UINT, WPARAM, LPARAM);
+LRESULT CallWindowProcW(WNDPROC, HWND, UINT, WPARAM, LPARAM);
+BOOL RegisterRawInputDevices(const RAWINPUTDEVICE*, UINT, UINT);
+UINT GetRawInputData(HRAWINPUT, UINT, LPVOID, PUINT, UINT);
+UINT GetRawInputBuffer(PRAWINPUT, PUINT, UINT);
+HCURSOR LoadCursorW(HINSTANCE, LPCWSTR);
+ATOM RegisterClassExW(const WNDCLASSEXW*);
+BOOL UnregisterClassW(LPCWSTR, HINSTANCE);
+HWND CreateWindowExW(DWORD, LPCWSTR, LPCWSTR, DWORD, int, int, int, int, HWND, HMENU, HINSTANCE, LPVOID);
+BOOL DestroyWindow(HWND);
+BOOL SetWindowTextW(HWND, LPCWSTR);
+BOOL ShowWindow(HWND, int);
+BOOL UpdateWindow(HWND);
+BOOL SetWindowPos(HWND, HWND, int, int, int, int, UINT);
+BOOL AdjustWindowRectEx(LPRECT, DWORD, BOOL, DWORD);
+LONG GetWindowLongW(HWND, int);
+LONG_PTR GetWindowLongPtrW(HWND, int);
+LONG_PTR SetWindowLongPtrW(HWND, int, LONG_PTR);
+BOOL SetPropW(HWND, LPCWSTR, HANDLE);
+HANDLE GetPropW(HWND, LPCWSTR);
+HANDLE RemovePropW(HWND, LPCWSTR);
+HMENU GetMenu(HWND);
+DWORD GetWindowThreadProcessId(HWND, LPDWORD);
+BOOL GetWindowRect(HWND, LPRECT);
+BOOL GetClientRect(HWND, LPRECT);
+BOOL GetKeyboardState(PBYTE);
+BOOL GetCursorPos(POINT*);
+int GetSystemMetrics(int);
+DWORD GetCurrentThreadId();
+HANDLE CreateWaitableTimerExW(LPVOID, LPCWSTR, DWORD, DWORD);
+BOOL SetWaitableTimer(HANDLE, const LARGE_INTEGER*, LONG, LPVOID, LPVOID, BOOL);
+HANDLE CreateEventW(LPVOID, BOOL, BOOL, LPCWSTR);
+BOOL SetEvent(HANDLE);
+BOOL ResetEvent(HANDLE);
+DWORD MsgWaitForMultipleObjectsEx(DWORD, const HANDLE*, DWORD, DWORD, DWORD);
+BOOL CloseHandle(HANDLE);
+void YieldProcessor();